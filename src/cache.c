@@ -0,0 +1,589 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "expression.h"
+#include "hash.h"
+#include "input.h"
+#include "readahead.h"
+#include "cache.h"
+#include "tmnsh.h"
+
+
+/***** Hash Function ********************************************************/
+
+/**
+ * unsigned long cache_hash_file(const char *path, unsigned long size)
+ *
+ * Hashes the first size bytes of the given file by mapping it into
+ * memory.
+ *
+ * Returns the hash, or 0 if the file could not be mapped.
+ */
+static unsigned long cache_hash_file(const char *path, unsigned long size) {
+	unsigned long hash;
+	void *data;
+	int fd;
+	
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return 0;
+	}
+	
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if (data == MAP_FAILED) {
+		return 0;
+	}
+	
+	madvise(data, size, MADV_SEQUENTIAL);
+	hash = hash_data(data, size, 0);
+	munmap(data, size);
+	
+	return hash;
+}
+
+
+/***** Cache Path Functions *************************************************/
+
+/**
+ * int cache_path_for(const char *script_path, char *absolute_path,
+ *                    char *cache_path, unsigned long *path_hash)
+ *
+ * Works out the absolute path of the given script and where its cache
+ * file lives, placing the results in absolute_path and cache_path (each
+ * of which must hold CACHE_PATH_MAX_SIZE bytes). If CACHE_DIR_VARIABLE
+ * names an absolute directory the cache lives there, named after the
+ * hash of the script's absolute path. Otherwise it lives next to the
+ * script with CACHE_SUFFIX appended to its name.
+ *
+ * NOTE Both paths are absolute so that they stay valid after the script
+ *      changes directory.
+ * NOTE A missing CACHE_DIR_VARIABLE directory is created, readable only
+ *      by its owner. A directory belonging to another user is not used,
+ *      as whoever owns it could plant cache files in it.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+static int cache_path_for(const char *script_path, char *absolute_path,
+		char *cache_path, unsigned long *path_hash) {
+	char *cache_dir = getenv(CACHE_DIR_VARIABLE);
+	char *resolved = realpath(script_path, NULL);
+	struct stat st;
+	int length;
+	
+	if (resolved == NULL || strlen(resolved) >= CACHE_PATH_MAX_SIZE) {
+		free(resolved);
+		return -1;
+	}
+	
+	strcpy(absolute_path, resolved);
+	free(resolved);
+	
+	*path_hash = hash_data(absolute_path, strlen(absolute_path), 0);
+	
+	if (cache_dir != NULL && *cache_dir == '/') {
+		if ((mkdir(cache_dir, 0700) == -1 && errno != EEXIST) ||
+				stat(cache_dir, &st) == -1 || !S_ISDIR(st.st_mode) ||
+				st.st_uid != geteuid()) {
+			return -1;
+		}
+		
+		length = snprintf(cache_path, CACHE_PATH_MAX_SIZE, "%s/%016lx%s",
+				cache_dir, *path_hash, CACHE_SUFFIX);
+	} else {
+		length = snprintf(cache_path, CACHE_PATH_MAX_SIZE, "%s%s",
+				absolute_path, CACHE_SUFFIX);
+	}
+	
+	if (length < 0 || length >= CACHE_PATH_MAX_SIZE) {
+		return -1;
+	}
+	
+	return 0;
+}
+
+
+/***** Cache Reader Functions ***********************************************/
+
+/**
+ * int cache_header_matches(cache_header_t *found, cache_header_t *wanted)
+ *
+ * Returns TRUE if the found header belongs to the same version of the
+ * same script as the wanted header, FALSE otherwise.
+ */
+static int cache_header_matches(cache_header_t *found,
+		cache_header_t *wanted) {
+	return (memcmp(found->magic, wanted->magic, sizeof(found->magic)) == 0 &&
+			found->version == wanted->version &&
+			found->path_hash == wanted->path_hash &&
+			found->script_size == wanted->script_size &&
+			found->script_mtime == wanted->script_mtime &&
+			found->script_mtime_nsec == wanted->script_mtime_nsec &&
+			found->script_hash == wanted->script_hash);
+}
+
+/**
+ * cache_writer_t *cache_writer_create(cache_header_t *header,
+ *                                     const char *script_path,
+ *                                     const char *cache_path)
+ *
+ * Creates an anonymous temporary file in the cache file's directory to
+ * write parsed expressions into. It is only linked into place by
+ * cache_writer_finish(), so a run which never reaches the end of its
+ * script (or which dies part way) leaves nothing behind.
+ *
+ * Returns a pointer to a new cache writer, or NULL if the directory
+ * cannot hold temporary files.
+ */
+static cache_writer_t *cache_writer_create(cache_header_t *header,
+		const char *script_path, const char *cache_path) {
+	char dir[CACHE_PATH_MAX_SIZE];
+	char *slash;
+	cache_writer_t *writer;
+	int fd;
+	
+	strcpy(dir, cache_path);
+	slash = strrchr(dir, '/');
+	
+	if (slash == NULL) {
+		strcpy(dir, ".");
+	} else if (slash == dir) {
+		dir[1] = '\0';
+	} else {
+		*slash = '\0';
+	}
+	
+	fd = open(dir, O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		return NULL;
+	}
+	
+	writer = malloc(sizeof(cache_writer_t));
+	writer->file = fdopen(fd, "w");
+	
+	if (writer->file == NULL) {
+		close(fd);
+		free(writer);
+		return NULL;
+	}
+	
+	writer->header = *header;
+	strcpy(writer->script_path, script_path);
+	strcpy(writer->cache_path, cache_path);
+	
+	/* Leave room for the header, which is written once complete. */
+	fwrite(&writer->header, sizeof(cache_header_t), 1, writer->file);
+	
+	return writer;
+}
+
+/**
+ * cache_t *cache_open(const char *script_path, cache_writer_t **writer)
+ *
+ * Looks for a valid cache file for the given script and maps it into
+ * memory. If there is none, a cache writer is created instead and
+ * placed in *writer, so that the cache can be filled as the script is
+ * parsed. Scripts smaller than CACHE_MIN_SCRIPT_SIZE are not cached.
+ *
+ * NOTE A cache file which belongs to another user, or which anyone else
+ *      could have written to, is ignored and left alone, since the
+ *      commands in it would be run as they stand.
+ *
+ * Returns a pointer to a new cache reader, or NULL if there is no valid
+ * cache file. The pointer must be passed to cache_close() once the
+ * cache is no longer needed.
+ */
+cache_t *cache_open(const char *script_path, cache_writer_t **writer) {
+	char absolute_path[CACHE_PATH_MAX_SIZE];
+	char cache_path[CACHE_PATH_MAX_SIZE];
+	cache_header_t header;
+	cache_header_t *found;
+	cache_t *cache;
+	struct stat st;
+	void *data;
+	int fd;
+	
+	*writer = NULL;
+	
+	if (stat(script_path, &st) == -1 || !S_ISREG(st.st_mode) ||
+			st.st_size < CACHE_MIN_SCRIPT_SIZE) {
+		return NULL;
+	}
+	
+	memset(&header, 0, sizeof(cache_header_t));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.version = CACHE_VERSION;
+	header.script_size = st.st_size;
+	header.script_mtime = st.st_mtim.tv_sec;
+	header.script_mtime_nsec = st.st_mtim.tv_nsec;
+	
+	if (cache_path_for(script_path, absolute_path, cache_path,
+			&header.path_hash) == -1) {
+		return NULL;
+	}
+	
+	header.script_hash = cache_hash_file(absolute_path, header.script_size);
+	if (header.script_hash == 0) {
+		return NULL;
+	}
+	
+	fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1 || fstat(fd, &st) == -1 ||
+			st.st_size < (off_t) sizeof(cache_header_t)) {
+		if (fd != -1) {
+			close(fd);
+		}
+		
+		*writer = cache_writer_create(&header, absolute_path, cache_path);
+		return NULL;
+	}
+	
+	if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+		close(fd);
+		return NULL;
+	}
+	
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+	
+	found = data;
+	if (!cache_header_matches(found, &header)) {
+		munmap(data, st.st_size);
+		*writer = cache_writer_create(&header, absolute_path, cache_path);
+		return NULL;
+	}
+	
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+	
+	cache = malloc(sizeof(cache_t));
+	cache->data = data;
+	cache->size = st.st_size;
+	cache->offset = sizeof(cache_header_t);
+	cache->num_records = found->num_records;
+	cache->records_read = 0;
+	strcpy(cache->path, cache_path);
+	
+	return cache;
+}
+
+/**
+ * void cache_close(cache_t *cache)
+ *
+ * Unmaps the cache file and frees the cache reader structure.
+ */
+void cache_close(cache_t *cache) {
+	munmap(cache->data, cache->size);
+	free(cache);
+}
+
+/**
+ * int cache_read_number(cache_t *cache, unsigned int *number)
+ *
+ * Reads a single number from the cache into the given location. Numbers
+ * are stored seven bits to a byte, least significant first, with the
+ * top bit of each byte set if more bytes follow.
+ *
+ * Returns 0 if successful, -1 if the cache is truncated.
+ */
+static int cache_read_number(cache_t *cache, unsigned int *number) {
+	unsigned char byte;
+	int shift = 0;
+	
+	*number = 0;
+	
+	do {
+		if (cache->offset >= cache->size || shift > 28) {
+			return -1;
+		}
+		
+		byte = cache->data[cache->offset++];
+		*number |= (unsigned int) (byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	
+	return 0;
+}
+
+/**
+ * char *cache_read_string(cache_t *cache)
+ *
+ * Reads a NUL-terminated string from the cache.
+ *
+ * Returns a pointer to the string within the mapped cache file, or NULL
+ * if the cache is truncated.
+ */
+static char *cache_read_string(cache_t *cache) {
+	char *string = cache->data + cache->offset;
+	char *end = memchr(string, '\0', cache->size - cache->offset);
+	
+	if (end == NULL) {
+		return NULL;
+	}
+	
+	cache->offset += end - string + 1;
+	
+	return string;
+}
+
+/**
+ * int cache_read_entry(cache_t *cache, readahead_entry_t *entry)
+ *
+ * Rebuilds the next expression (or parse error, along with the parser's
+ * message for it) stored in the cache into the given read-ahead entry,
+ * without reading, tokenising or parsing the script itself.
+ *
+ * NOTE A record which is truncated, or whose command or argument counts
+ *      are zero or beyond the expression limits, marks the cache as
+ *      corrupt: the script stops and the cache file is removed, so that
+ *      the next run parses the script and writes a fresh one.
+ *
+ * Returns TRUE if an entry was read, FALSE if there are no more entries.
+ */
+int cache_read_entry(cache_t *cache, readahead_entry_t *entry) {
+	unsigned int kind;
+	unsigned int background;
+	unsigned int num_cmds;
+	unsigned int num_args;
+	command_t *cmd;
+	char *string;
+	int corrupt = FALSE;
+	
+	if (cache->records_read >= cache->num_records) {
+		return FALSE;
+	}
+	
+	entry->error = READAHEAD_OK;
+	entry->expr = NULL;
+	entry->line = NULL;
+	entry->message = NULL;
+	
+	if (cache_read_number(cache, &kind) == -1) {
+		corrupt = TRUE;
+	} else if (kind != CACHE_RECORD_EXPRESSION) {
+		string = cache_read_string(cache);
+		
+		if (string == NULL) {
+			corrupt = TRUE;
+		} else {
+			entry->error = (kind == CACHE_RECORD_TOKENISE_ERROR) ?
+					READAHEAD_TOKENISE_ERROR : READAHEAD_PARSE_ERROR;
+			entry->line = malloc(strlen(string) + 1);
+			strcpy(entry->line, string);
+		}
+		
+		if (!corrupt && kind == CACHE_RECORD_PARSE_ERROR) {
+			string = cache_read_string(cache);
+			
+			if (string == NULL) {
+				corrupt = TRUE;
+			} else if (string[0] != '\0') {
+				entry->message = malloc(strlen(string) + 1);
+				strcpy(entry->message, string);
+			}
+		}
+	} else if (cache_read_number(cache, &background) == -1 ||
+			cache_read_number(cache, &num_cmds) == -1 || num_cmds == 0 ||
+			num_cmds > EXPRESSION_MAX_CMDS) {
+		corrupt = TRUE;
+	} else {
+		entry->expr = expression_create();
+		entry->expr->background = background;
+		
+		while (!corrupt && num_cmds-- > 0) {
+			if (cache_read_number(cache, &num_args) == -1 || num_args == 0 ||
+					num_args > COMMAND_MAX_ARGV) {
+				corrupt = TRUE;
+				break;
+			}
+			
+			cmd = command_create();
+			expression_cmd_push(entry->expr, cmd);
+			
+			while (num_args-- > 0) {
+				string = cache_read_string(cache);
+				
+				if (string == NULL) {
+					corrupt = TRUE;
+					break;
+				}
+				
+				command_argv_push(cmd, string);
+			}
+		}
+	}
+	
+	if (corrupt) {
+		printf("!tmnsh: Script cache is corrupt, stopping.\n");
+		unlink(cache->path); /* Rebuilt by the next run. */
+		
+		if (entry->expr != NULL) {
+			expression_destroy(entry->expr);
+		}
+		
+		free(entry->line);
+		free(entry->message);
+		cache->records_read = cache->num_records;
+		return FALSE;
+	}
+	
+	cache->records_read++;
+	
+	return TRUE;
+}
+
+
+/***** Cache Writer Functions ***********************************************/
+
+/**
+ * void cache_write_number(cache_writer_t *writer, unsigned int number)
+ *
+ * Writes a single number to the cache in the form read back by
+ * cache_read_number().
+ */
+static void cache_write_number(cache_writer_t *writer, unsigned int number) {
+	while (number >= 0x80) {
+		putc((number & 0x7f) | 0x80, writer->file);
+		number >>= 7;
+	}
+	
+	putc(number, writer->file);
+}
+
+/**
+ * void cache_write_string(cache_writer_t *writer, const char *string)
+ *
+ * Writes a NUL-terminated string to the cache.
+ */
+static void cache_write_string(cache_writer_t *writer, const char *string) {
+	fwrite(string, 1, strlen(string) + 1, writer->file);
+}
+
+/**
+ * void cache_write_entry(cache_writer_t *writer, readahead_entry_t *entry)
+ *
+ * Appends the given read-ahead entry to the cache.
+ */
+void cache_write_entry(cache_writer_t *writer, readahead_entry_t *entry) {
+	command_t *cmd;
+	int index;
+	int arg;
+	
+	if (entry->error == READAHEAD_TOKENISE_ERROR) {
+		cache_write_number(writer, CACHE_RECORD_TOKENISE_ERROR);
+		cache_write_string(writer, entry->line);
+	} else if (entry->error == READAHEAD_PARSE_ERROR) {
+		cache_write_number(writer, CACHE_RECORD_PARSE_ERROR);
+		cache_write_string(writer, entry->line);
+		cache_write_string(writer, (entry->message != NULL) ?
+				entry->message : "");
+	} else {
+		cache_write_number(writer, CACHE_RECORD_EXPRESSION);
+		cache_write_number(writer, entry->expr->background);
+		cache_write_number(writer, entry->expr->num_cmds);
+		
+		for (index = 0; index < entry->expr->num_cmds; index++) {
+			cmd = entry->expr->cmds[index];
+			cache_write_number(writer, cmd->num_args);
+			
+			for (arg = 0; arg < cmd->num_args; arg++) {
+				cache_write_string(writer, cmd->argv[arg]);
+			}
+		}
+	}
+	
+	writer->header.num_records++;
+}
+
+/**
+ * void cache_writer_finish(cache_writer_t *writer)
+ *
+ * Completes the cache by writing its header and linking it into place,
+ * replacing any stale cache file. If the script changed while it was
+ * being parsed, the cache is abandoned instead. The writer structure is
+ * freed either way.
+ */
+void cache_writer_finish(cache_writer_t *writer) {
+	char proc_path[CACHE_PATH_MAX_SIZE];
+	char temp_path[CACHE_PATH_MAX_SIZE];
+	struct stat st;
+	int length;
+	
+	if (stat(writer->script_path, &st) == -1 ||
+			(unsigned long) st.st_size != writer->header.script_size ||
+			st.st_mtim.tv_sec != writer->header.script_mtime ||
+			st.st_mtim.tv_nsec != writer->header.script_mtime_nsec) {
+		cache_writer_abandon(writer);
+		return;
+	}
+	
+	length = snprintf(temp_path, CACHE_PATH_MAX_SIZE, "%s.%d",
+			writer->cache_path, (int) getpid());
+	
+	if (length < 0 || length >= CACHE_PATH_MAX_SIZE ||
+			fseek(writer->file, 0, SEEK_SET) == -1) {
+		cache_writer_abandon(writer);
+		return;
+	}
+	
+	fwrite(&writer->header, sizeof(cache_header_t), 1, writer->file);
+	
+	if (fflush(writer->file) == EOF || ferror(writer->file)) {
+		cache_writer_abandon(writer);
+		return;
+	}
+	
+	sprintf(proc_path, "/proc/self/fd/%d", fileno(writer->file));
+	unlink(temp_path);
+	
+	if (linkat(AT_FDCWD, proc_path, AT_FDCWD, temp_path,
+			AT_SYMLINK_FOLLOW) == 0) {
+		if (rename(temp_path, writer->cache_path) == -1) {
+			unlink(temp_path);
+		}
+	}
+	
+	cache_writer_abandon(writer);
+}
+
+/**
+ * void cache_writer_abandon(cache_writer_t *writer)
+ *
+ * Closes the cache writer's temporary file without linking it into
+ * place and frees the writer structure.
+ */
+void cache_writer_abandon(cache_writer_t *writer) {
+	fclose(writer->file);
+	free(writer);
+}
@@ -0,0 +1,83 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define CACHE_MAGIC "TMNC"
+#define CACHE_VERSION 2
+#define CACHE_SUFFIX ".tmnc"
+#define CACHE_DIR_VARIABLE "TMNSH_CACHE_DIR"
+#define CACHE_MIN_SCRIPT_SIZE 65536
+#define CACHE_PATH_MAX_SIZE 4097
+
+#define CACHE_RECORD_EXPRESSION 0
+#define CACHE_RECORD_TOKENISE_ERROR 1
+#define CACHE_RECORD_PARSE_ERROR 2
+
+
+/***** Structures ***********************************************************/
+
+/* Cache File Header Structure
+ *
+ * NOTE A cache file is only valid for the script whose path, size,
+ *      modification time and content hash match its header, and is only
+ *      trusted if it belongs to the user running the script and no one
+ *      else can write to it. Cache files are written in the host's
+ *      native byte order.
+ */
+typedef struct cache_header_s {
+	char magic[4];
+	unsigned int version;
+	unsigned long path_hash;
+	unsigned long script_size;
+	long script_mtime;
+	long script_mtime_nsec;
+	unsigned long script_hash;
+	unsigned long num_records;
+	} cache_header_t;
+
+/* Cache Reader Structure */
+typedef struct cache_s {
+	char *data;
+	unsigned long size;
+	unsigned long offset;
+	unsigned long num_records;
+	unsigned long records_read;
+	char path[CACHE_PATH_MAX_SIZE];
+	} cache_t;
+
+/* Cache Writer Structure */
+typedef struct cache_writer_s {
+	FILE *file;
+	cache_header_t header;
+	char script_path[CACHE_PATH_MAX_SIZE];
+	char cache_path[CACHE_PATH_MAX_SIZE];
+	} cache_writer_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Cache Reader Functions */
+cache_t *cache_open(const char *script_path, cache_writer_t **writer);
+void cache_close(cache_t *cache);
+int cache_read_entry(cache_t *cache, readahead_entry_t *entry);
+
+/* Cache Writer Functions */
+void cache_write_entry(cache_writer_t *writer, readahead_entry_t *entry);
+void cache_writer_finish(cache_writer_t *writer);
+void cache_writer_abandon(cache_writer_t *writer);
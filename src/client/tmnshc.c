@@ -0,0 +1,194 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../server.h"
+#include "../tmnsh.h"
+
+
+/***** Client Functions *****************************************************/
+
+/**
+ * void show_usage()
+ *
+ * Prints a usage message to the standard error.
+ */
+void show_usage() {
+	fprintf(stderr, "usage: tmnshc socket command\n");
+}
+
+/**
+ * int client_write(int fd, const void *data, unsigned long size)
+ *
+ * Writes all size bytes of data to the given socket.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+int client_write(int fd, const void *data, unsigned long size) {
+	const char *buf = data;
+	long result;
+	
+	while (size > 0) {
+		result = send(fd, buf, size, MSG_NOSIGNAL);
+		
+		if (result == -1 && errno == EINTR) {
+			continue;
+		} else if (result == -1) {
+			return -1;
+		}
+		
+		buf += result;
+		size -= result;
+	}
+	
+	return 0;
+}
+
+/**
+ * int client_send_request(int fd, const char *cwd, char *envp[],
+ *                         const char *script)
+ *
+ * Sends a request to run the given script in the given directory and
+ * environment to the server, passing along our standard input, output
+ * and error.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+int client_send_request(int fd, const char *cwd, char *envp[],
+		const char *script) {
+	char control[CMSG_SPACE(sizeof(int) * SERVER_NUM_FDS)];
+	int fds[SERVER_NUM_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+	server_request_t request;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	long result;
+	int index;
+	
+	request.magic = SERVER_MAGIC;
+	request.version = SERVER_VERSION;
+	request.cwd_size = strlen(cwd);
+	request.env_size = 0;
+	request.script_size = strlen(script);
+	
+	for (index = 0; envp[index] != NULL; index++) {
+		request.env_size += strlen(envp[index]) + 1;
+	}
+	
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	iov.iov_base = &request;
+	iov.iov_len = sizeof(request);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	
+	do {
+		result = sendmsg(fd, &msg, MSG_NOSIGNAL);
+	} while (result == -1 && errno == EINTR);
+	
+	if (result == -1 ||
+			client_write(fd, (char *) &request + result,
+					sizeof(request) - result) == -1 ||
+			client_write(fd, cwd, request.cwd_size) == -1) {
+		return -1;
+	}
+	
+	for (index = 0; envp[index] != NULL; index++) {
+		if (client_write(fd, envp[index], strlen(envp[index]) + 1) == -1) {
+			return -1;
+		}
+	}
+	
+	if (client_write(fd, script, request.script_size) == -1) {
+		return -1;
+	}
+	
+	return 0;
+}
+
+
+/***** Main Function ********************************************************/
+
+/**
+ * int main(int argc, char *argv[], char *envp)
+ *
+ * Has a tmnsh server run the given command string in our working
+ * directory and environment with our standard input, output and error,
+ * and exits with the command's exit status.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+	struct sockaddr_un address;
+	char cwd[CWD_MAX_SIZE];
+	long result;
+	int status;
+	int fd;
+	
+	if (argc != 3) {
+		show_usage();
+		return 2;
+	}
+	
+	if (getcwd(cwd, CWD_MAX_SIZE) == NULL ||
+			strlen(argv[1]) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "!tmnshc: %s\n", strerror(ENAMETOOLONG));
+		return 1;
+	}
+	
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, argv[1]);
+	
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	
+	if (fd == -1 ||
+			connect(fd, (struct sockaddr *) &address, sizeof(address)) == -1 ||
+			client_send_request(fd, cwd, envp, argv[2]) == -1) {
+		fprintf(stderr, "!tmnshc: %s - %s (%d)\n", argv[1], strerror(errno),
+				errno);
+		return 1;
+	}
+	
+	do {
+		result = recv(fd, &status, sizeof(status), MSG_WAITALL);
+	} while (result == -1 && errno == EINTR);
+	
+	if (result != sizeof(status)) {
+		fprintf(stderr, "!tmnshc: Server closed the connection.\n");
+		return 1;
+	}
+	
+	return status;
+}
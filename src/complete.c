@@ -0,0 +1,781 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "complete.h"
+#include "hash.h"
+#include "pathhash.h"
+#include "tmnsh.h"
+
+
+/***** Globals **************************************************************/
+
+/* Path Trie - Every command name on PATH, built on first use. */
+static pathtrie_node_t *trie = NULL;
+static char *trie_path = NULL;
+
+/* Path Watch - Keeps the trie (and path hash) up to date. If inotify is
+ * not available, the PATH directories' modification times are checked
+ * instead and the trie rebuilt when they change. */
+static int watch_fd = -1;
+static unsigned long watch_stamp = 0;
+
+/* Directory Cache - Recent listings, for file completion. */
+static complete_dir_t listings[COMPLETE_DIR_CACHE_SIZE];
+static int next_listing = 0;
+
+
+/***** Completion Results Functions *****************************************/
+
+/**
+ * void complete_init(complete_t *results)
+ *
+ * Initialises an empty set of completion results.
+ */
+void complete_init(complete_t *results) {
+	results->names = NULL;
+	results->size = 0;
+	results->max_size = 0;
+	results->num_names = 0;
+	results->common = 0;
+}
+
+/**
+ * void complete_free(complete_t *results)
+ *
+ * Frees the names held by the given completion results, leaving them
+ * empty.
+ */
+void complete_free(complete_t *results) {
+	free(results->names);
+	complete_init(results);
+}
+
+/**
+ * int complete_add(complete_t *results, const char *name)
+ *
+ * Adds the given name to the completion results, updating the length of
+ * the prefix they all share.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+static int complete_add(complete_t *results, const char *name) {
+	unsigned long length = strlen(name) + 1;
+	unsigned long max_size;
+	char *names;
+	int common;
+	
+	if (results->size + length > results->max_size) {
+		max_size = (results->max_size == 0) ? 256 : results->max_size * 2;
+		
+		while (max_size < results->size + length) {
+			max_size *= 2;
+		}
+		
+		names = realloc(results->names, max_size);
+		
+		if (names == NULL) {
+			return -1;
+		}
+		
+		results->names = names;
+		results->max_size = max_size;
+	}
+	
+	if (results->num_names == 0) {
+		results->common = length - 1;
+	} else {
+		for (common = 0; common < results->common &&
+				results->names[common] == name[common]; common++) {
+		}
+		
+		results->common = common;
+	}
+	
+	memcpy(results->names + results->size, name, length);
+	results->size += length;
+	results->num_names++;
+	
+	return 0;
+}
+
+
+/***** Path Trie Functions **************************************************/
+
+/**
+ * pathtrie_node_t *pathtrie_node(const char *label, int length)
+ *
+ * Creates a trie node whose label is the first length bytes of label.
+ *
+ * Returns a pointer to the node if successful, NULL if unsuccessful.
+ */
+static pathtrie_node_t *pathtrie_node(const char *label, int length) {
+	pathtrie_node_t *node = malloc(sizeof(pathtrie_node_t));
+	
+	if (node == NULL) {
+		return NULL;
+	}
+	
+	node->label = malloc(length + 1);
+	
+	if (node->label == NULL) {
+		free(node);
+		return NULL;
+	}
+	
+	memcpy(node->label, label, length);
+	node->label[length] = '\0';
+	node->terminal = FALSE;
+	node->child = NULL;
+	node->sibling = NULL;
+	
+	return node;
+}
+
+/**
+ * void pathtrie_free(pathtrie_node_t *node)
+ *
+ * Frees the given trie node, its children and its later siblings.
+ */
+static void pathtrie_free(pathtrie_node_t *node) {
+	pathtrie_node_t *sibling;
+	
+	while (node != NULL) {
+		sibling = node->sibling;
+		pathtrie_free(node->child);
+		free(node->label);
+		free(node);
+		node = sibling;
+	}
+}
+
+/**
+ * void pathtrie_insert(pathtrie_node_t *node, const char *name)
+ *
+ * Adds the given name to the trie below node, splitting the label of an
+ * existing node where the name leaves it.
+ */
+static void pathtrie_insert(pathtrie_node_t *node, const char *name) {
+	pathtrie_node_t **link;
+	pathtrie_node_t *child;
+	pathtrie_node_t *split;
+	int common;
+	
+	while (*name != '\0') {
+		for (link = &node->child; *link != NULL &&
+				(unsigned char) (*link)->label[0] < (unsigned char) *name;
+				link = &(*link)->sibling) {
+		}
+		
+		child = *link;
+		
+		if (child == NULL || child->label[0] != *name) {
+			child = pathtrie_node(name, strlen(name));
+			
+			if (child != NULL) {
+				child->terminal = TRUE;
+				child->sibling = *link;
+				*link = child;
+			}
+			
+			return;
+		}
+		
+		for (common = 0; child->label[common] != '\0' &&
+				child->label[common] == name[common]; common++) {
+		}
+		
+		if (child->label[common] != '\0') {
+			split = pathtrie_node(child->label, common);
+			
+			if (split == NULL) {
+				return;
+			}
+			
+			memmove(child->label, child->label + common,
+					strlen(child->label + common) + 1);
+			split->child = child;
+			split->sibling = child->sibling;
+			child->sibling = NULL;
+			*link = split;
+			child = split;
+		}
+		
+		name += common;
+		node = child;
+	}
+	
+	node->terminal = TRUE;
+}
+
+/**
+ * int pathtrie_remove(pathtrie_node_t *node, const char *name)
+ *
+ * Removes the given name from the trie below node, freeing nodes which
+ * are no longer needed and merging any left with a single child.
+ *
+ * Returns TRUE if the name was removed, FALSE if it was not there.
+ */
+static int pathtrie_remove(pathtrie_node_t *node, const char *name) {
+	pathtrie_node_t **link;
+	pathtrie_node_t *child;
+	pathtrie_node_t *grandchild;
+	char *label;
+	int length;
+	
+	if (*name == '\0') {
+		if (node->terminal == FALSE) {
+			return FALSE;
+		}
+		
+		node->terminal = FALSE;
+		return TRUE;
+	}
+	
+	for (link = &node->child; *link != NULL && (*link)->label[0] != *name;
+			link = &(*link)->sibling) {
+	}
+	
+	child = *link;
+	
+	if (child == NULL) {
+		return FALSE;
+	}
+	
+	length = strlen(child->label);
+	
+	if (strncmp(child->label, name, length) != 0 ||
+			pathtrie_remove(child, name + length) == FALSE) {
+		return FALSE;
+	}
+	
+	if (child->terminal == TRUE) {
+		return TRUE;
+	}
+	
+	if (child->child == NULL) {
+		*link = child->sibling;
+		free(child->label);
+		free(child);
+	} else if (child->child->sibling == NULL) {
+		grandchild = child->child;
+		label = malloc(length + strlen(grandchild->label) + 1);
+		
+		if (label == NULL) {
+			return TRUE; /* Unmerged, but still correct. */
+		}
+		
+		strcpy(label, child->label);
+		strcat(label, grandchild->label);
+		free(grandchild->label);
+		grandchild->label = label;
+		grandchild->sibling = child->sibling;
+		*link = grandchild;
+		free(child->label);
+		free(child);
+	}
+	
+	return TRUE;
+}
+
+/**
+ * void pathtrie_collect(pathtrie_node_t *node, char *name, int length,
+ *                       complete_t *results)
+ *
+ * Adds every name in the trie at or below node to the results, in sorted
+ * order. The buffer holds the name up to and including node's label
+ * (length bytes) and must be PATHHASH_PATH_MAX_SIZE bytes long.
+ */
+static void pathtrie_collect(pathtrie_node_t *node, char *name, int length,
+		complete_t *results) {
+	pathtrie_node_t *child;
+	int label_length;
+	
+	if (node->terminal == TRUE) {
+		name[length] = '\0';
+		complete_add(results, name);
+	}
+	
+	for (child = node->child; child != NULL; child = child->sibling) {
+		label_length = strlen(child->label);
+		
+		if (length + label_length < PATHHASH_PATH_MAX_SIZE) {
+			memcpy(name + length, child->label, label_length);
+			pathtrie_collect(child, name, length + label_length, results);
+		}
+	}
+}
+
+/**
+ * void pathtrie_found(const char *name, void *data)
+ *
+ * Adds a name found by pathhash_scan() to the trie.
+ */
+static void pathtrie_found(const char *name, void *data) {
+	pathtrie_insert(trie, name);
+}
+
+
+/***** Path Watch Functions *************************************************/
+
+/**
+ * int complete_next_dir(const char **dirs, char *dir)
+ *
+ * Copies the next absolute directory from the PATH-style list at *dirs
+ * into the buffer supplied (PATHHASH_PATH_MAX_SIZE bytes long), skipping
+ * relative ones, and advances *dirs past it.
+ *
+ * Returns TRUE if a directory was found, FALSE at the end of the list.
+ */
+static int complete_next_dir(const char **dirs, char *dir) {
+	const char *end;
+	int length;
+	
+	while (**dirs != '\0') {
+		end = strchr(*dirs, ':');
+		if (end == NULL) {
+			end = *dirs + strlen(*dirs);
+		}
+		
+		length = end - *dirs;
+		
+		if (**dirs == '/' && length < PATHHASH_PATH_MAX_SIZE) {
+			memcpy(dir, *dirs, length);
+			dir[length] = '\0';
+			*dirs = (*end == ':') ? end + 1 : end;
+			return TRUE;
+		}
+		
+		*dirs = (*end == ':') ? end + 1 : end;
+	}
+	
+	return FALSE;
+}
+
+/**
+ * unsigned long complete_stamp()
+ *
+ * Returns a hash of the modification times of the PATH directories,
+ * which changes whenever a command is added to or removed from one.
+ */
+static unsigned long complete_stamp() {
+	char dir[PATHHASH_PATH_MAX_SIZE];
+	const char *dirs = trie_path;
+	unsigned long stamp = 0;
+	struct stat st;
+	
+	while (complete_next_dir(&dirs, dir)) {
+		if (stat(dir, &st) == 0) {
+			stamp = hash_data(&st.st_mtim, sizeof(st.st_mtim), stamp);
+		}
+	}
+	
+	return stamp;
+}
+
+/**
+ * void complete_build()
+ *
+ * (Re)builds the trie of command names from the PATH directories, which
+ * fills the path hash at the same time, and starts watching them.
+ *
+ * NOTE The directories are watched before they are scanned, so that a
+ *      command added during the scan is not missed.
+ */
+static void complete_build() {
+	char dir[PATHHASH_PATH_MAX_SIZE];
+	const char *path = getenv("PATH");
+	const char *dirs;
+	int num_watched = 0;
+	
+	pathtrie_free(trie);
+	free(trie_path);
+	
+	if (path == NULL) {
+		path = "";
+	}
+	
+	trie = pathtrie_node("", 0);
+	trie_path = malloc(strlen(path) + 1);
+	
+	if (trie == NULL || trie_path == NULL) {
+		pathtrie_free(trie);
+		free(trie_path);
+		trie = NULL;
+		trie_path = NULL;
+		return;
+	}
+	
+	strcpy(trie_path, path);
+	
+	if (watch_fd != -1) {
+		close(watch_fd);
+	}
+	
+	watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	dirs = trie_path;
+	
+	while (watch_fd != -1 && complete_next_dir(&dirs, dir)) {
+		if (inotify_add_watch(watch_fd, dir, IN_CREATE | IN_DELETE |
+				IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB) != -1) {
+			num_watched++;
+		}
+	}
+	
+	if (watch_fd != -1 && num_watched == 0) {
+		close(watch_fd);
+		watch_fd = -1;
+	}
+	
+	watch_stamp = complete_stamp();
+	
+	pathhash_scan(pathtrie_found, NULL);
+}
+
+/**
+ * void complete_update()
+ *
+ * Brings the trie of command names (and the path hash) up to date with
+ * any changes to the PATH directories since it was built, by reading
+ * the inotify events queued since the last update. Each command name
+ * changed is looked up in PATH again, so a command which still exists
+ * in another directory stays. This does nothing until the trie has been
+ * built, and costs one non-blocking read() when nothing has changed.
+ */
+void complete_update() {
+	union {
+		struct inotify_event event;
+		char data[COMPLETE_EVENT_BUFFER_SIZE];
+	} buffer;
+	struct inotify_event *event;
+	const char *path = getenv("PATH");
+	char *data;
+	long length;
+	
+	if (trie == NULL) {
+		return;
+	}
+	
+	if (strcmp((path != NULL) ? path : "", trie_path) != 0) {
+		complete_build();
+		return;
+	}
+	
+	if (watch_fd == -1) {
+		if (complete_stamp() != watch_stamp) {
+			complete_build();
+		}
+		
+		return;
+	}
+	
+	while ((length = read(watch_fd, &buffer, sizeof(buffer))) > 0) {
+		for (data = buffer.data; data < buffer.data + length;
+				data += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *) data;
+			
+			if (event->mask & IN_Q_OVERFLOW) {
+				complete_build();
+				return;
+			}
+			
+			if (event->len == 0 || event->name[0] == '.') {
+				continue;
+			}
+			
+			if (pathhash_resolve(event->name) != NULL) {
+				pathtrie_insert(trie, event->name);
+			} else {
+				pathtrie_remove(trie, event->name);
+			}
+		}
+	}
+}
+
+
+/***** Directory Cache Functions ********************************************/
+
+/**
+ * int complete_compare(const void *a, const void *b)
+ *
+ * Compares two names for qsort().
+ */
+static int complete_compare(const void *a, const void *b) {
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/**
+ * int complete_read_dir(const char *path, complete_dir_t *listing)
+ *
+ * Lists the given directory into the listing supplied, sorted, with a
+ * slash on the end of the name of each subdirectory.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+static int complete_read_dir(const char *path, complete_dir_t *listing) {
+	char file_path[PATHHASH_PATH_MAX_SIZE];
+	char name[PATHHASH_PATH_MAX_SIZE];
+	complete_t names;
+	struct dirent *file;
+	struct stat st;
+	char **sorted;
+	char *entry;
+	DIR *stream;
+	int is_dir;
+	int i;
+	
+	stream = opendir(path);
+	
+	if (stream == NULL) {
+		return -1;
+	}
+	
+	complete_init(&names);
+	
+	while ((file = readdir(stream)) != NULL) {
+		if (strcmp(file->d_name, ".") == 0 ||
+				strcmp(file->d_name, "..") == 0) {
+			continue;
+		}
+		
+		is_dir = (file->d_type == DT_DIR);
+		
+		if (file->d_type == DT_LNK || file->d_type == DT_UNKNOWN) {
+			snprintf(file_path, PATHHASH_PATH_MAX_SIZE, "%s/%s", path,
+					file->d_name);
+			is_dir = (stat(file_path, &st) == 0 && S_ISDIR(st.st_mode));
+		}
+		
+		if (snprintf(name, PATHHASH_PATH_MAX_SIZE, "%s%s", file->d_name,
+				is_dir ? "/" : "") < PATHHASH_PATH_MAX_SIZE) {
+			complete_add(&names, name);
+		}
+	}
+	
+	closedir(stream);
+	
+	/* Sort the names, then pack them in order into the listing. */
+	sorted = malloc((names.num_names + 1) * sizeof(char *));
+	listing->names = malloc(names.size + 1);
+	
+	if (sorted == NULL || listing->names == NULL) {
+		free(sorted);
+		free(listing->names);
+		listing->names = NULL;
+		complete_free(&names);
+		return -1;
+	}
+	
+	for (i = 0, entry = names.names; i < names.num_names; i++) {
+		sorted[i] = entry;
+		entry += strlen(entry) + 1;
+	}
+	
+	qsort(sorted, names.num_names, sizeof(char *), complete_compare);
+	listing->size = 0;
+	
+	for (i = 0; i < names.num_names; i++) {
+		strcpy(listing->names + listing->size, sorted[i]);
+		listing->size += strlen(sorted[i]) + 1;
+	}
+	
+	free(sorted);
+	complete_free(&names);
+	
+	return 0;
+}
+
+/**
+ * complete_dir_t *complete_listing(const char *path)
+ *
+ * Finds the listing of the given directory, reusing a cached one if the
+ * directory has not changed since it was made.
+ *
+ * Returns a pointer to the listing, or NULL if the directory cannot be
+ * listed.
+ */
+static complete_dir_t *complete_listing(const char *path) {
+	complete_dir_t *listing = NULL;
+	struct stat st;
+	int i;
+	
+	if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) {
+		return NULL;
+	}
+	
+	for (i = 0; i < COMPLETE_DIR_CACHE_SIZE; i++) {
+		if (listings[i].names != NULL && listings[i].dev == st.st_dev &&
+				listings[i].ino == st.st_ino) {
+			listing = &listings[i];
+			break;
+		}
+	}
+	
+	if (listing != NULL && listing->mtime == st.st_mtim.tv_sec &&
+			listing->mtime_nsec == st.st_mtim.tv_nsec &&
+			listing->mtime < listing->listed) {
+		return listing;
+	}
+	
+	if (listing == NULL) {
+		listing = &listings[next_listing];
+		next_listing = (next_listing + 1) % COMPLETE_DIR_CACHE_SIZE;
+	}
+	
+	free(listing->names);
+	listing->names = NULL;
+	listing->dev = st.st_dev;
+	listing->ino = st.st_ino;
+	listing->mtime = st.st_mtim.tv_sec;
+	listing->mtime_nsec = st.st_mtim.tv_nsec;
+	listing->listed = time(NULL);
+	
+	if (complete_read_dir(path, listing) == -1) {
+		return NULL;
+	}
+	
+	return listing;
+}
+
+
+/***** Completion Functions *************************************************/
+
+/**
+ * int complete_command(const char *prefix, complete_t *results)
+ *
+ * Finds every command name on PATH beginning with the given prefix. The
+ * trie of command names is built on first use and kept up to date (see
+ * complete_update()) rather than rescanned.
+ *
+ * Returns the number of names found.
+ */
+int complete_command(const char *prefix, complete_t *results) {
+	char name[PATHHASH_PATH_MAX_SIZE];
+	pathtrie_node_t *node;
+	int label_length;
+	int length = 0;
+	int n;
+	
+	if (trie == NULL) {
+		complete_build();
+	} else {
+		complete_update();
+	}
+	
+	if (trie == NULL) {
+		return 0;
+	}
+	
+	/* Follow the prefix down the trie, possibly ending part way along a
+	 * node's label. */
+	node = trie;
+	
+	while (*prefix != '\0') {
+		for (node = node->child; node != NULL && node->label[0] != *prefix;
+				node = node->sibling) {
+		}
+		
+		if (node == NULL) {
+			return 0;
+		}
+		
+		label_length = strlen(node->label);
+		n = strlen(prefix);
+		
+		if (n > label_length) {
+			n = label_length;
+		}
+		
+		if (strncmp(node->label, prefix, n) != 0 ||
+				length + label_length >= PATHHASH_PATH_MAX_SIZE) {
+			return 0;
+		}
+		
+		memcpy(name + length, node->label, label_length);
+		length += label_length;
+		prefix += n;
+	}
+	
+	pathtrie_collect(node, name, length, results);
+	
+	return results->num_names;
+}
+
+/**
+ * int complete_file(const char *prefix, complete_t *results)
+ *
+ * Finds every file name beginning with the given prefix, which may
+ * include a directory part. Names beginning with a dot are only found if
+ * the prefix's file part begins with one too.
+ *
+ * Returns the number of names found.
+ */
+int complete_file(const char *prefix, complete_t *results) {
+	char dir[PATHHASH_PATH_MAX_SIZE];
+	char name[PATHHASH_PATH_MAX_SIZE];
+	const char *slash = strrchr(prefix, '/');
+	const char *base = (slash != NULL) ? slash + 1 : prefix;
+	int dir_length = (slash != NULL) ? slash - prefix + 1 : 0;
+	int base_length = strlen(base);
+	complete_dir_t *listing;
+	const char *entry;
+	
+	if (dir_length + base_length >= PATHHASH_PATH_MAX_SIZE) {
+		return 0;
+	}
+	
+	if (slash == NULL) {
+		strcpy(dir, ".");
+	} else {
+		memcpy(dir, prefix, dir_length);
+		dir[dir_length] = '\0';
+	}
+	
+	listing = complete_listing(dir);
+	
+	if (listing == NULL) {
+		return 0;
+	}
+	
+	memcpy(name, prefix, dir_length);
+	
+	for (entry = listing->names; entry < listing->names + listing->size;
+			entry += strlen(entry) + 1) {
+		if (strncmp(entry, base, base_length) != 0 ||
+				(entry[0] == '.' && base[0] != '.') ||
+				dir_length + strlen(entry) >= PATHHASH_PATH_MAX_SIZE) {
+			continue;
+		}
+		
+		strcpy(name + dir_length, entry);
+		complete_add(results, name);
+	}
+	
+	return results->num_names;
+}
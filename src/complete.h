@@ -0,0 +1,79 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define COMPLETE_DIR_CACHE_SIZE 16
+#define COMPLETE_EVENT_BUFFER_SIZE 4096
+
+
+/***** Structures ***********************************************************/
+
+/* Completion Results Structure
+ *
+ * NOTE The names are stored one after another, each NUL-terminated, in
+ *      sorted order. common is the length of the prefix they all share.
+ */
+typedef struct complete_s {
+	char *names;
+	unsigned long size;
+	unsigned long max_size;
+	int num_names;
+	int common;
+	} complete_t;
+
+/* Path Trie Node Structure
+ *
+ * NOTE The trie is compressed: each node's label is the run of bytes on
+ *      the edge leading to it, and a node with a single child is only
+ *      kept if a command name ends there. Siblings are sorted by the
+ *      first byte of their labels.
+ */
+typedef struct pathtrie_node_s {
+	char *label;
+	int terminal;
+	struct pathtrie_node_s *child;
+	struct pathtrie_node_s *sibling;
+	} pathtrie_node_t;
+
+/* Directory Listing Structure
+ *
+ * NOTE A cached listing is reused while the directory's modification
+ *      time is unchanged, unless that time was still the current second
+ *      when it was listed (in which case it might have changed again
+ *      without its modification time changing).
+ */
+typedef struct complete_dir_s {
+	dev_t dev;
+	ino_t ino;
+	long mtime;
+	long mtime_nsec;
+	long listed;
+	char *names;
+	unsigned long size;
+	} complete_dir_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Completion Functions */
+void complete_init(complete_t *results);
+void complete_free(complete_t *results);
+void complete_update();
+int complete_command(const char *prefix, complete_t *results);
+int complete_file(const char *prefix, complete_t *results);
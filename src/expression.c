@@ -20,6 +20,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "expression.h"
 #include "tmnsh.h"
@@ -123,6 +124,7 @@ expression_t *expression_create() {
 	int index;
 	
 	expr->background = FALSE;
+	expr->tail = FALSE;
 	expr->num_cmds = 0;
 	expr->max_cmds = EXPRESSION_MAX_CMDS;
 	
@@ -34,6 +34,7 @@ typedef struct command_s {
 /* Expression Structure */
 typedef struct expression_s {
 	int background;
+	int tail; /* TRUE if nothing follows, so the last command may exec. */
 	int num_cmds;
 	int max_cmds;
 	command_t *cmds[EXPRESSION_MAX_CMDS];
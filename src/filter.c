@@ -0,0 +1,489 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "expression.h"
+#include "filter.h"
+#include "scan.h"
+#include "tmnsh.h"
+
+
+/***** Structures ***********************************************************/
+
+/* Output Buffer Structure */
+typedef struct output_s {
+	int fd;
+	int error;
+	unsigned long size;
+	char data[FILTER_BLOCK_SIZE];
+	} output_t;
+
+
+/***** I/O Functions ********************************************************/
+
+/**
+ * long filter_read(int fd, char *buffer, unsigned long size)
+ *
+ * Reads at most size bytes from the given file descriptor, retrying if
+ * interrupted by a signal.
+ *
+ * Returns the number of bytes read, 0 at end of file or -1 on error.
+ */
+static long filter_read(int fd, char *buffer, unsigned long size) {
+	long result;
+	
+	do {
+		result = read(fd, buffer, size);
+	} while (result == -1 && errno == EINTR);
+	
+	return result;
+}
+
+/**
+ * int filter_write(int fd, const char *data, unsigned long size)
+ *
+ * Writes all size bytes of data to the given file descriptor.
+ *
+ * Returns 0 if successful, or the exit status a real filter would have
+ * had (i.e. as though killed by SIGPIPE) if unsuccessful.
+ */
+static int filter_write(int fd, const char *data, unsigned long size) {
+	long result;
+	
+	while (size > 0) {
+		result = write(fd, data, size);
+		
+		if (result == -1 && errno == EINTR) {
+			continue;
+		} else if (result == -1) {
+			return (errno == EPIPE) ? 128 + SIGPIPE : 2;
+		}
+		
+		data += result;
+		size -= result;
+	}
+	
+	return 0;
+}
+
+/**
+ * void output_flush(output_t *out)
+ *
+ * Writes out everything held in the output buffer.
+ */
+static void output_flush(output_t *out) {
+	if (out->error == 0 && out->size > 0) {
+		out->error = filter_write(out->fd, out->data, out->size);
+	}
+	
+	out->size = 0;
+}
+
+/**
+ * void output_append(output_t *out, const char *data, unsigned long size)
+ *
+ * Adds data to the output buffer, writing the buffer out when full.
+ * Data too large to buffer is written out directly.
+ */
+static void output_append(output_t *out, const char *data,
+		unsigned long size) {
+	if (out->size + size > FILTER_BLOCK_SIZE) {
+		output_flush(out);
+	}
+	
+	if (size > FILTER_BLOCK_SIZE) {
+		if (out->error == 0) {
+			out->error = filter_write(out->fd, data, size);
+		}
+	} else {
+		memcpy(out->data + out->size, data, size);
+		out->size += size;
+	}
+}
+
+
+/***** Filters **************************************************************/
+
+/**
+ * int filter_grep_lines(filter_t *filter, output_t *out,
+ *                       const char *data, unsigned long size)
+ *
+ * Copies every line of data containing the filter's pattern to the
+ * output. A final line without a newline is given one.
+ *
+ * Returns TRUE if any line matched, FALSE otherwise.
+ */
+static int filter_grep_lines(filter_t *filter, output_t *out,
+		const char *data, unsigned long size) {
+	const char *limit = data + size;
+	const char *match;
+	const char *start;
+	const char *end;
+	int matched = FALSE;
+	
+	while (data < limit) {
+		match = scan_find(data, limit - data, filter->pattern,
+				filter->pattern_size);
+		
+		if (match == NULL) {
+			break;
+		}
+		
+		start = memrchr(data, '\n', match - data);
+		start = (start == NULL) ? data : start + 1;
+		end = memchr(match, '\n', limit - match);
+		end = (end == NULL) ? limit : end + 1;
+		
+		output_append(out, start, end - start);
+		if (end[-1] != '\n') {
+			output_append(out, "\n", 1);
+		}
+		
+		matched = TRUE;
+		data = end;
+	}
+	
+	return matched;
+}
+
+/**
+ * int filter_grep(filter_t *filter)
+ *
+ * As "grep -F pattern". Input is read in blocks of FILTER_BLOCK_SIZE and
+ * searched a block at a time, with any partial line at the end of one
+ * block carried over to the start of the next.
+ *
+ * Returns 0 if any line matched, 1 if none did, otherwise an error
+ * status.
+ */
+static int filter_grep(filter_t *filter) {
+	output_t *out = malloc(sizeof(output_t));
+	unsigned long capacity = FILTER_BLOCK_SIZE;
+	unsigned long size = 0;
+	unsigned long end;
+	char *buffer = malloc(capacity);
+	char *last_newline;
+	int matched = FALSE;
+	int status;
+	long result = 1;
+	
+	out->fd = filter->out_fd;
+	out->error = 0;
+	out->size = 0;
+	
+	while (result > 0 && out->error == 0) {
+		/* Make room for lines longer than the buffer. */
+		if (size == capacity) {
+			capacity *= 2;
+			buffer = realloc(buffer, capacity);
+		}
+		
+		result = filter_read(filter->in_fd, buffer + size, capacity - size);
+		
+		if (result > 0) {
+			size += result;
+			last_newline = memrchr(buffer, '\n', size);
+			
+			if (last_newline == NULL) {
+				continue;
+			}
+			
+			end = last_newline - buffer + 1;
+		} else {
+			end = size;
+		}
+		
+		if (filter_grep_lines(filter, out, buffer, end)) {
+			matched = TRUE;
+		}
+		
+		memmove(buffer, buffer + end, size - end);
+		size -= end;
+	}
+	
+	output_flush(out);
+	
+	if (result == -1) {
+		status = 2;
+	} else if (out->error != 0) {
+		status = out->error;
+	} else {
+		status = (matched == TRUE) ? 0 : 1;
+	}
+	
+	free(buffer);
+	free(out);
+	
+	return status;
+}
+
+/**
+ * int filter_wc(filter_t *filter)
+ *
+ * As "wc -l", counting newlines a block at a time.
+ *
+ * Returns 0 if successful, otherwise an error status.
+ */
+static int filter_wc(filter_t *filter) {
+	char *buffer = malloc(FILTER_BLOCK_SIZE);
+	char count[32];
+	unsigned long num_lines = 0;
+	long result;
+	
+	while ((result = filter_read(filter->in_fd, buffer,
+			FILTER_BLOCK_SIZE)) > 0) {
+		num_lines += scan_count(buffer, result, '\n');
+	}
+	
+	free(buffer);
+	
+	if (result == -1) {
+		return 2;
+	}
+	
+	sprintf(count, "%lu\n", num_lines);
+	
+	return filter_write(filter->out_fd, count, strlen(count));
+}
+
+/**
+ * int filter_head(filter_t *filter)
+ *
+ * As "head -n count". Whole blocks are copied to the output until the
+ * block containing the last newline wanted, which is cut short. Input
+ * is not read any further, so the writer is stopped as it would be by
+ * a real head.
+ *
+ * Returns 0 if successful, otherwise an error status.
+ */
+static int filter_head(filter_t *filter) {
+	char *buffer = malloc(FILTER_BLOCK_SIZE);
+	unsigned long remaining = filter->num_lines;
+	unsigned long num_lines;
+	const char *end;
+	int status = 0;
+	long result;
+	
+	while (remaining > 0 && status == 0) {
+		result = filter_read(filter->in_fd, buffer, FILTER_BLOCK_SIZE);
+		
+		if (result <= 0) {
+			status = (result == 0) ? 0 : 2;
+			break;
+		}
+		
+		num_lines = scan_count(buffer, result, '\n');
+		
+		if (num_lines < remaining) {
+			remaining -= num_lines;
+			end = buffer + result;
+		} else {
+			end = buffer;
+			
+			while (remaining > 0) {
+				end = (char *) memchr(end, '\n', buffer + result - end) + 1;
+				remaining--;
+			}
+		}
+		
+		status = filter_write(filter->out_fd, buffer, end - buffer);
+	}
+	
+	free(buffer);
+	
+	return status;
+}
+
+
+/***** Filter Functions *****************************************************/
+
+/**
+ * filter_t *filter_create(command_t *cmd)
+ *
+ * Checks whether the given command is one which can be run as an
+ * in-process filter, exactly as written: "grep -F string", "wc -l",
+ * "head", "head -n count" or "head -count". Any other options (or any
+ * file arguments) mean the real command must be run instead.
+ *
+ * Returns a pointer to a new filter structure, or NULL if the command
+ * cannot be run as a filter. The pointer must be passed to
+ * filter_destroy() once the filter is no longer needed.
+ */
+filter_t *filter_create(command_t *cmd) {
+	filter_t *filter;
+	const char *count = NULL;
+	char *end;
+	int kind;
+	
+	if (strcmp(cmd->argv[0], "grep") == 0 && cmd->num_args == 3 &&
+			strcmp(cmd->argv[1], "-F") == 0) {
+		kind = FILTER_GREP;
+	} else if (strcmp(cmd->argv[0], "wc") == 0 && cmd->num_args == 2 &&
+			strcmp(cmd->argv[1], "-l") == 0) {
+		kind = FILTER_WC;
+	} else if (strcmp(cmd->argv[0], "head") == 0 && cmd->num_args == 1) {
+		kind = FILTER_HEAD;
+		count = "10";
+	} else if (strcmp(cmd->argv[0], "head") == 0 && cmd->num_args == 3 &&
+			strcmp(cmd->argv[1], "-n") == 0) {
+		kind = FILTER_HEAD;
+		count = cmd->argv[2];
+	} else if (strcmp(cmd->argv[0], "head") == 0 && cmd->num_args == 2 &&
+			cmd->argv[1][0] == '-') {
+		kind = FILTER_HEAD;
+		count = cmd->argv[1] + 1;
+	} else {
+		return NULL;
+	}
+	
+	filter = malloc(sizeof(filter_t));
+	filter->kind = kind;
+	filter->pattern = NULL;
+	filter->pattern_size = 0;
+	filter->num_lines = 0;
+	filter->in_fd = -1;
+	filter->out_fd = -1;
+	filter->status = 0;
+	
+	if (kind == FILTER_GREP) {
+		filter->pattern_size = strlen(cmd->argv[2]);
+		filter->pattern = malloc(filter->pattern_size + 1);
+		strcpy(filter->pattern, cmd->argv[2]);
+	} else if (kind == FILTER_HEAD) {
+		if (*count < '0' || *count > '9') {
+			free(filter);
+			return NULL;
+		}
+		
+		filter->num_lines = strtoul(count, &end, 10);
+		
+		if (*end != '\0') {
+			free(filter);
+			return NULL;
+		}
+	}
+	
+	scan_init();
+	
+	return filter;
+}
+
+/**
+ * void filter_destroy(filter_t *filter)
+ *
+ * Frees the given filter structure and its pattern.
+ */
+void filter_destroy(filter_t *filter) {
+	free(filter->pattern);
+	free(filter);
+}
+
+/**
+ * int filter_run(filter_t *filter, int in_fd, int out_fd)
+ *
+ * Runs the filter from in_fd to out_fd in the calling thread until its
+ * input ends or it has no more use for it. Both descriptors are then
+ * closed, unless they are standard input or output, so that the stages
+ * either side of the filter see it finish.
+ *
+ * Returns the filter's exit status.
+ */
+int filter_run(filter_t *filter, int in_fd, int out_fd) {
+	filter->in_fd = in_fd;
+	filter->out_fd = out_fd;
+	
+	if (filter->kind == FILTER_GREP) {
+		filter->status = filter_grep(filter);
+	} else if (filter->kind == FILTER_WC) {
+		filter->status = filter_wc(filter);
+	} else {
+		filter->status = filter_head(filter);
+	}
+	
+	if (in_fd > STDERR_FILENO) {
+		close(in_fd);
+	}
+	
+	if (out_fd > STDERR_FILENO) {
+		close(out_fd);
+	}
+	
+	return filter->status;
+}
+
+/**
+ * void *filter_thread(void *data)
+ *
+ * Thread entry point for filter_start(). All signals are blocked so that
+ * they keep going to the shell's main thread, and so that writing to a
+ * closed pipe fails with EPIPE rather than killing the shell.
+ */
+static void *filter_thread(void *data) {
+	filter_t *filter = data;
+	sigset_t signals;
+	
+	sigfillset(&signals);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	
+	filter_run(filter, filter->in_fd, filter->out_fd);
+	
+	return NULL;
+}
+
+/**
+ * int filter_start(filter_t *filter, int in_fd, int out_fd)
+ *
+ * Runs the filter from in_fd to out_fd on a thread of its own. The
+ * filter takes over both descriptors, as in filter_run(), and must be
+ * passed to filter_join() once started.
+ *
+ * Returns 0 if successful, -1 if no thread could be started (in which
+ * case the descriptors are left untouched).
+ */
+int filter_start(filter_t *filter, int in_fd, int out_fd) {
+	filter->in_fd = in_fd;
+	filter->out_fd = out_fd;
+	
+	if (pthread_create(&filter->thread, NULL, filter_thread, filter) != 0) {
+		return -1;
+	}
+	
+	return 0;
+}
+
+/**
+ * int filter_join(filter_t *filter)
+ *
+ * Waits for a filter started with filter_start() to finish.
+ *
+ * Returns the filter's exit status.
+ */
+int filter_join(filter_t *filter) {
+	pthread_join(filter->thread, NULL);
+	
+	return filter->status;
+}
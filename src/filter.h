@@ -0,0 +1,56 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define FILTER_BLOCK_SIZE 131072
+
+#define FILTER_GREP 0
+#define FILTER_WC 1
+#define FILTER_HEAD 2
+
+
+/***** Structures ***********************************************************/
+
+/* Filter Structure
+ *
+ * NOTE A filter is an in-process stand-in for one of a handful of common
+ *      text filters - "grep -F string", "wc -l" and "head -n count" -
+ *      which saves a fork() and execvp() when it is used as a pipeline
+ *      stage.
+ */
+typedef struct filter_s {
+	int kind;
+	char *pattern;
+	unsigned long pattern_size;
+	unsigned long num_lines;
+	int in_fd;
+	int out_fd;
+	int status;
+	pthread_t thread;
+	} filter_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Filter Functions */
+filter_t *filter_create(command_t *cmd);
+void filter_destroy(filter_t *filter);
+int filter_run(filter_t *filter, int in_fd, int out_fd);
+int filter_start(filter_t *filter, int in_fd, int out_fd);
+int filter_join(filter_t *filter);
@@ -0,0 +1,63 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <string.h>
+
+#include "hash.h"
+
+
+/***** Hash Functions *******************************************************/
+
+/**
+ * unsigned long hash_data(const void *data, unsigned long size,
+ *                         unsigned long hash)
+ *
+ * Folds size bytes of data into the given hash, which should be 0 for
+ * the first block. This is FNV-1a taken a word rather than a byte at a
+ * time, so that hashing a multi-hundred-megabyte script stays cheap
+ * next to parsing it. It is shared by the script cache, the path hash,
+ * completion and memoisation.
+ *
+ * Returns the updated hash.
+ */
+unsigned long hash_data(const void *data, unsigned long size,
+		unsigned long hash) {
+	const unsigned char *bytes = data;
+	unsigned long word;
+	
+	if (hash == 0) {
+		hash = HASH_SEED;
+	}
+	
+	while (size >= sizeof(word)) {
+		memcpy(&word, bytes, sizeof(word));
+		hash = (hash ^ word) * HASH_PRIME;
+		hash ^= hash >> 29;
+		bytes += sizeof(word);
+		size -= sizeof(word);
+	}
+	
+	while (size > 0) {
+		hash = (hash ^ *bytes++) * HASH_PRIME;
+		size--;
+	}
+	
+	return hash;
+}
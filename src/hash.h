@@ -0,0 +1,29 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define HASH_SEED 14695981039346656037UL
+#define HASH_PRIME 1099511628211UL
+
+
+/***** Function Declarations ************************************************/
+
+/* Hash Functions */
+unsigned long hash_data(const void *data, unsigned long size,
+		unsigned long hash);
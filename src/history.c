@@ -0,0 +1,543 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "scan.h"
+#include "tmnsh.h"
+
+
+/***** History Functions ****************************************************/
+
+/**
+ * history_t *history_open()
+ *
+ * Opens the history file named by TMNSH_HISTORY, or ~/.tmnsh_history if
+ * that is not set, creating it if need be, and maps the records already
+ * in it. Setting TMNSH_HISTORY to an empty string turns history off.
+ *
+ * Returns a pointer to the history if successful, NULL if unsuccessful.
+ */
+history_t *history_open() {
+	char path[HISTORY_PATH_MAX_SIZE];
+	const char *variable = getenv(HISTORY_FILE_VARIABLE);
+	const char *home = getenv("HOME");
+	history_t *history;
+	int length;
+	int fd;
+	
+	if (variable != NULL) {
+		length = snprintf(path, HISTORY_PATH_MAX_SIZE, "%s", variable);
+	} else if (home != NULL) {
+		length = snprintf(path, HISTORY_PATH_MAX_SIZE, "%s/%s", home,
+				HISTORY_FILE_NAME);
+	} else {
+		return NULL;
+	}
+	
+	if (length <= 0 || length >= HISTORY_PATH_MAX_SIZE) {
+		return NULL;
+	}
+	
+	fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	
+	if (fd == -1) {
+		return NULL;
+	}
+	
+	history = malloc(sizeof(history_t));
+	
+	if (history == NULL) {
+		close(fd);
+		return NULL;
+	}
+	
+	history->fd = fd;
+	history->data = NULL;
+	history->size = 0;
+	history->offsets = NULL;
+	history->num_entries = 0;
+	history->max_entries = 0;
+	history->num_indexed = 0;
+	history->index = NULL;
+	
+	history_refresh(history);
+	
+	return history;
+}
+
+/**
+ * void history_forget(history_t *history)
+ *
+ * Unmaps the history file and drops every entry and the index, so that
+ * the file will be read again from the start.
+ */
+static void history_forget(history_t *history) {
+	int i;
+	
+	if (history->data != NULL) {
+		munmap(history->data, history->size);
+	}
+	
+	if (history->index != NULL) {
+		for (i = 0; i < HISTORY_INDEX_BUCKETS; i++) {
+			free(history->index[i].data);
+			free(history->index[i].blocks);
+		}
+		
+		free(history->index);
+	}
+	
+	free(history->offsets);
+	
+	history->data = NULL;
+	history->size = 0;
+	history->offsets = NULL;
+	history->num_entries = 0;
+	history->max_entries = 0;
+	history->num_indexed = 0;
+	history->index = NULL;
+}
+
+/**
+ * void history_close(history_t *history)
+ *
+ * Unmaps and closes the given history, freeing it.
+ */
+void history_close(history_t *history) {
+	if (history == NULL) {
+		return;
+	}
+	
+	history_forget(history);
+	close(history->fd);
+	free(history);
+}
+
+/**
+ * int history_append_entry(history_t *history, unsigned long end)
+ *
+ * Records that a new entry runs from the end of the last one up to the
+ * given offset (just past its newline).
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+static int history_append_entry(history_t *history, unsigned long end) {
+	unsigned long *offsets;
+	unsigned int max_entries;
+	
+	if (history->num_entries + 1 >= history->max_entries) {
+		max_entries = (history->max_entries == 0) ? 1024 :
+				history->max_entries * 2;
+		offsets = realloc(history->offsets,
+				max_entries * sizeof(unsigned long));
+		
+		if (offsets == NULL) {
+			return -1;
+		}
+		
+		if (history->offsets == NULL) {
+			offsets[0] = 0;
+		}
+		
+		history->offsets = offsets;
+		history->max_entries = max_entries;
+	}
+	
+	history->offsets[++history->num_entries] = end;
+	
+	return 0;
+}
+
+/**
+ * int history_refresh(history_t *history)
+ *
+ * Picks up any records appended to the history file since it was last
+ * mapped, by this session or any other, remapping the file as needed.
+ *
+ * NOTE If the file has shrunk (i.e. the user cleared it) the history is
+ *      read again from the start.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+int history_refresh(history_t *history) {
+	struct stat st;
+	unsigned long offset;
+	const char *end;
+	char *data;
+	
+	if (fstat(history->fd, &st) == -1) {
+		return -1;
+	}
+	
+	if ((unsigned long) st.st_size < history->size) {
+		history_forget(history);
+	}
+	
+	if ((unsigned long) st.st_size == history->size) {
+		return 0;
+	}
+	
+	if (history->data == NULL) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, history->fd, 0);
+	} else {
+		data = mremap(history->data, history->size, st.st_size,
+				MREMAP_MAYMOVE);
+	}
+	
+	if (data == MAP_FAILED) {
+		history_forget(history);
+		return -1;
+	}
+	
+	history->data = data;
+	history->size = st.st_size;
+	
+	offset = (history->offsets == NULL) ? 0 :
+			history->offsets[history->num_entries];
+	
+	while (offset < history->size) {
+		end = memchr(data + offset, '\n', history->size - offset);
+		
+		if (end == NULL) {
+			break; /* Still being written. */
+		}
+		
+		offset = end - data + 1;
+		
+		if (history_append_entry(history, offset) == -1) {
+			return -1;
+		}
+	}
+	
+	return 0;
+}
+
+/**
+ * int history_add(history_t *history, const char *line)
+ *
+ * Appends the given line to the history file as a single record. Empty
+ * lines, and lines repeating the most recent entry, are not added.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+int history_add(history_t *history, const char *line) {
+	unsigned long size = strlen(line);
+	unsigned long last_size;
+	const char *last;
+	char *record;
+	long written;
+	
+	if (size == 0 || strchr(line, '\n') != NULL) {
+		return 0;
+	}
+	
+	history_refresh(history);
+	
+	if (history->num_entries > 0) {
+		last = history_entry(history, history->num_entries - 1, &last_size);
+		
+		if (last_size == size && memcmp(last, line, size) == 0) {
+			return 0;
+		}
+	}
+	
+	record = malloc(size + 1);
+	
+	if (record == NULL) {
+		return -1;
+	}
+	
+	memcpy(record, line, size);
+	record[size] = '\n';
+	
+	/* One write() per record, so that O_APPEND keeps it in one piece. */
+	written = write(history->fd, record, size + 1);
+	free(record);
+	
+	return (written == size + 1) ? 0 : -1;
+}
+
+/**
+ * const char *history_entry(history_t *history, unsigned int entry,
+ *                           unsigned long *length)
+ *
+ * Returns a pointer to the given entry (oldest first) in the mapped file
+ * and stores its length, which excludes the newline. The entry is NOT
+ * NUL-terminated.
+ */
+const char *history_entry(history_t *history, unsigned int entry,
+		unsigned long *length) {
+	*length = history->offsets[entry + 1] - history->offsets[entry] - 1;
+	
+	return history->data + history->offsets[entry];
+}
+
+
+/***** History Search Functions *********************************************/
+
+/**
+ * unsigned int history_trigram(const char *text)
+ *
+ * Returns the index bucket for the three bytes at the given text.
+ */
+static unsigned int history_trigram(const char *text) {
+	unsigned int trigram = ((unsigned char) text[0] << 16) |
+			((unsigned char) text[1] << 8) | (unsigned char) text[2];
+	
+	return ((trigram * 2654435761u) >> 16) % HISTORY_INDEX_BUCKETS;
+}
+
+/**
+ * int history_list_add(history_list_t *list, unsigned int entry)
+ *
+ * Adds the given entry to the end of the list, unless it is already
+ * there. Entries are added in order, so every list stays sorted.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+static int history_list_add(history_list_t *list, unsigned int entry) {
+	history_block_t *blocks;
+	unsigned char *data;
+	unsigned int delta = entry - list->last;
+	unsigned int max_size;
+	unsigned int max_blocks;
+	
+	if (list->num_entries > 0 && delta == 0) {
+		return 0;
+	}
+	
+	/* Room for another block, and for the longest delta. */
+	if (list->num_blocks == list->max_blocks) {
+		max_blocks = (list->max_blocks == 0) ? 1 : list->max_blocks * 2;
+		blocks = realloc(list->blocks, max_blocks * sizeof(history_block_t));
+		
+		if (blocks == NULL) {
+			return -1;
+		}
+		
+		list->blocks = blocks;
+		list->max_blocks = max_blocks;
+	}
+	
+	if (list->size + 5 > list->max_size) {
+		max_size = (list->max_size == 0) ? 16 : list->max_size * 2;
+		data = realloc(list->data, max_size);
+		
+		if (data == NULL) {
+			return -1;
+		}
+		
+		list->data = data;
+		list->max_size = max_size;
+	}
+	
+	if (list->num_entries % HISTORY_BLOCK_ENTRIES == 0) {
+		list->blocks[list->num_blocks].first = entry;
+		list->blocks[list->num_blocks].offset = list->size;
+		list->num_blocks++;
+	} else {
+		while (delta >= 0x80) {
+			list->data[list->size++] = (delta & 0x7f) | 0x80;
+			delta >>= 7;
+		}
+		
+		list->data[list->size++] = delta;
+	}
+	
+	list->last = entry;
+	list->num_entries++;
+	
+	return 0;
+}
+
+/**
+ * int history_list_block(history_list_t *list, unsigned int block,
+ *                        unsigned int *entries)
+ *
+ * Decodes the given block of the list into the array supplied, which
+ * must have room for HISTORY_BLOCK_ENTRIES entries.
+ *
+ * Returns the number of entries in the block.
+ */
+static int history_list_block(history_list_t *list, unsigned int block,
+		unsigned int *entries) {
+	unsigned int offset = list->blocks[block].offset;
+	unsigned int end = (block + 1 < list->num_blocks) ?
+			list->blocks[block + 1].offset : list->size;
+	unsigned int delta;
+	int shift;
+	int n = 0;
+	
+	entries[n++] = list->blocks[block].first;
+	
+	while (offset < end) {
+		delta = 0;
+		shift = 0;
+		
+		do {
+			delta |= (list->data[offset] & 0x7f) << shift;
+			shift += 7;
+		} while (list->data[offset++] & 0x80);
+		
+		entries[n] = entries[n-1] + delta;
+		n++;
+	}
+	
+	return n;
+}
+
+/**
+ * int history_index(history_t *history, unsigned int count)
+ *
+ * Adds up to count entries not yet indexed to the trigram index, which
+ * maps each (hashed) three-byte sequence to the list of entries which
+ * contain it. The index is built while the line editor waits for keys
+ * (or by the first search, if it gets there first) rather than at
+ * startup, and grows with the history after that.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+int history_index(history_t *history, unsigned int count) {
+	unsigned long length;
+	unsigned long i;
+	const char *text;
+	
+	if (history->index == NULL) {
+		history->index = calloc(HISTORY_INDEX_BUCKETS,
+				sizeof(history_list_t));
+		
+		if (history->index == NULL) {
+			return -1;
+		}
+	}
+	
+	while (history->num_indexed < history->num_entries && count-- > 0) {
+		text = history_entry(history, history->num_indexed, &length);
+		
+		for (i = 0; i + 2 < length; i++) {
+			if (history_list_add(&history->index[history_trigram(text + i)],
+					history->num_indexed) == -1) {
+				return -1;
+			}
+		}
+		
+		history->num_indexed++;
+	}
+	
+	return 0;
+}
+
+/**
+ * int history_matches(history_t *history, unsigned int entry,
+ *                     const char *query, unsigned long query_size)
+ *
+ * Returns TRUE if the given entry contains the query, FALSE otherwise.
+ */
+static int history_matches(history_t *history, unsigned int entry,
+		const char *query, unsigned long query_size) {
+	unsigned long length;
+	const char *text = history_entry(history, entry, &length);
+	
+	return scan_find(text, length, query, query_size) != NULL;
+}
+
+/**
+ * int history_search(history_t *history, const char *query, int before)
+ *
+ * Finds the most recent entry older than the given one which contains
+ * the query. Pass the number of entries to search the whole history.
+ *
+ * NOTE Queries of three or more bytes only look at the entries in the
+ *      shortest index list among the query's trigrams, which is usually
+ *      a tiny fraction of the history. Each candidate is checked, since
+ *      sharing a trigram bucket does not mean containing the query.
+ *
+ * Returns the index of the entry found, or -1 if there is none.
+ */
+int history_search(history_t *history, const char *query, int before) {
+	unsigned long query_size = strlen(query);
+	unsigned int entries[HISTORY_BLOCK_ENTRIES];
+	history_list_t *list = NULL;
+	history_list_t *candidate;
+	unsigned long i;
+	int low;
+	int high;
+	int middle;
+	int n;
+	
+	if (before > (int) history->num_entries) {
+		before = history->num_entries;
+	}
+	
+	if (query_size < 3 ||
+			history_index(history, history->num_entries) == -1) {
+		while (--before >= 0) {
+			if (history_matches(history, before, query, query_size)) {
+				return before;
+			}
+		}
+		
+		return -1;
+	}
+	
+	for (i = 0; i + 2 < query_size; i++) {
+		candidate = &history->index[history_trigram(query + i)];
+		
+		if (list == NULL || candidate->num_entries < list->num_entries) {
+			list = candidate;
+		}
+	}
+	
+	/* Find the blocks holding entries older than the given one. */
+	low = 0;
+	high = list->num_blocks;
+	
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		
+		if ((int) list->blocks[middle].first < before) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	
+	while (--low >= 0) {
+		n = history_list_block(list, low, entries);
+		
+		while (--n >= 0) {
+			if ((int) entries[n] < before && history_matches(history,
+					entries[n], query, query_size)) {
+				return entries[n];
+			}
+		}
+	}
+	
+	return -1;
+}
@@ -0,0 +1,88 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define HISTORY_FILE_VARIABLE "TMNSH_HISTORY"
+#define HISTORY_FILE_NAME ".tmnsh_history"
+#define HISTORY_PATH_MAX_SIZE 4097
+#define HISTORY_INDEX_BUCKETS 65536
+#define HISTORY_BLOCK_ENTRIES 64
+
+
+/***** Structures ***********************************************************/
+
+/* History Index Block Structure - Where a block of a list starts. */
+typedef struct history_block_s {
+	unsigned int first;
+	unsigned int offset;
+	} history_block_t;
+
+/* History Index List Structure
+ *
+ * NOTE The entries containing a trigram, in ascending order, are stored
+ *      in blocks of HISTORY_BLOCK_ENTRIES. Each block records its first
+ *      entry; the rest are stored as variable-length deltas from the
+ *      entry before, so most take a single byte. Blocks are decoded
+ *      whole, which lets a search walk a list backwards.
+ */
+typedef struct history_list_s {
+	unsigned char *data;
+	unsigned int size;
+	unsigned int max_size;
+	history_block_t *blocks;
+	unsigned int num_blocks;
+	unsigned int max_blocks;
+	unsigned int num_entries;
+	unsigned int last;
+	} history_list_t;
+
+/* History Structure
+ *
+ * NOTE The history file is a sequence of newline-terminated records,
+ *      each appended with a single write() to a descriptor opened with
+ *      O_APPEND, so concurrent sessions can share one file without
+ *      their records interleaving. It is mapped read-only and remapped
+ *      as it grows; a trailing record without its newline is one still
+ *      being written and is left until it is complete.
+ */
+typedef struct history_s {
+	int fd;
+	char *data;
+	unsigned long size;
+	unsigned long *offsets;
+	unsigned int num_entries;
+	unsigned int max_entries;
+	unsigned int num_indexed;
+	history_list_t *index;
+	} history_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* History Functions */
+history_t *history_open();
+void history_close(history_t *history);
+int history_refresh(history_t *history);
+int history_add(history_t *history, const char *line);
+const char *history_entry(history_t *history, unsigned int entry,
+		unsigned long *length);
+
+/* History Search Functions */
+int history_index(history_t *history, unsigned int count);
+int history_search(history_t *history, const char *query, int before);
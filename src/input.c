@@ -0,0 +1,184 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "input.h"
+#include "tmnsh.h"
+
+
+/***** Input Source Functions ***********************************************/
+
+/**
+ * void input_init_stream(input_t *input, FILE *stream)
+ *
+ * Initialises an input source which reads from the given stream.
+ */
+void input_init_stream(input_t *input, FILE *stream) {
+	input->stream = stream;
+	input->cursor = NULL;
+}
+
+/**
+ * void input_init_string(input_t *input, const char *string)
+ *
+ * Initialises an input source which reads directly from the given
+ * NUL-terminated string. The string must outlive the input source.
+ */
+void input_init_string(input_t *input, const char *string) {
+	input->stream = NULL;
+	input->cursor = string;
+}
+
+
+/***** Input Functions ******************************************************/
+
+/**
+ * int read_data(FILE *stream, char *buffer, int buffer_size)
+ *
+ * Reads at most buffer_size-1 bytes of input from the given stream into
+ * the buffer supplied.
+ *
+ * NOTE Semicolons are treated as newline characters.
+ * NOTE If a line of input is too long to fit in the buffer, it will
+ *      NOT result in an overflow, but simply be "chomped" from the
+ *      input stream and discarded.
+ * NOTE Hash characters ('#') and any following characters up to a
+ *      newline or EOF will be discarded - comment your scripts!
+ *
+ * Returns TRUE if there is more data to read from the stream, FALSE
+ * otherwise.
+ */
+int read_data(FILE *stream, char *buffer, int buffer_size) {
+	int character = 0;
+	char *buf = buffer;
+	int bytes_read = 0;
+	
+	while (bytes_read < buffer_size-1) {
+		character = fgetc(stream);
+		
+		if (character == ';' || character == '\n' || character == EOF ||
+			character == '#') {
+				break;
+		}
+		
+		*buf++ = character;
+		bytes_read++;
+	}
+	
+	*buf = '\0';
+	
+	while ((character != ';') && (character != '\n') && (character != EOF)) {
+		character = fgetc(stream);
+	}
+	
+	if (character == EOF) {
+		return FALSE;
+	} else {
+		return TRUE;
+	}
+}
+
+/**
+ * int read_string_data(const char **cursor, char *buffer, int buffer_size)
+ *
+ * Reads at most buffer_size-1 bytes of input from the string at *cursor
+ * into the buffer supplied, advancing the cursor past the line read.
+ *
+ * NOTE This follows exactly the same rules as read_data(), with the
+ *      string's terminating NUL standing in for EOF.
+ *
+ * Returns TRUE if there is more data to read from the string, FALSE
+ * otherwise.
+ */
+int read_string_data(const char **cursor, char *buffer, int buffer_size) {
+	const char *str = *cursor;
+	char *buf = buffer;
+	int bytes_read = 0;
+	
+	while (bytes_read < buffer_size-1) {
+		if (*str == ';' || *str == '\n' || *str == '\0' || *str == '#') {
+			break;
+		}
+		
+		*buf++ = *str++;
+		bytes_read++;
+	}
+	
+	*buf = '\0';
+	
+	while ((*str != ';') && (*str != '\n') && (*str != '\0')) {
+		str++;
+	}
+	
+	if (*str == '\0') {
+		*cursor = str;
+		return FALSE;
+	} else {
+		*cursor = str + 1;
+		return TRUE;
+	}
+}
+
+/**
+ * int input_pending(input_t *input)
+ *
+ * Checks whether the given source already holds unread data in memory:
+ * the rest of a string, or whatever a stream's buffer has read ahead.
+ * Reading a line may then go ahead without waiting for the stream's
+ * descriptor to become readable.
+ *
+ * NOTE Only glibc's FILE buffer can be looked into; elsewhere the
+ *      caller has to make the stream unbuffered instead.
+ *
+ * Returns TRUE if there is unread data in memory, FALSE if there is
+ * none, or -1 if it cannot be told.
+ */
+int input_pending(input_t *input) {
+	if (input->stream == NULL) {
+		return (*input->cursor != '\0');
+	}
+	
+#ifdef __GLIBC__
+	return (input->stream->_IO_read_ptr < input->stream->_IO_read_end);
+#else
+	return -1;
+#endif
+}
+
+/**
+ * int input_read_line(input_t *input, char *buffer, int buffer_size)
+ *
+ * Reads a line of input from the given input source into the buffer
+ * supplied, using read_data() or read_string_data() as appropriate.
+ *
+ * Returns TRUE if there is more data to read from the source, FALSE
+ * otherwise.
+ */
+int input_read_line(input_t *input, char *buffer, int buffer_size) {
+	if (input->stream != NULL) {
+		return read_data(input->stream, buffer, buffer_size);
+	}
+	
+	return read_string_data(&input->cursor, buffer, buffer_size);
+}
+
@@ -0,0 +1,42 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Structures ***********************************************************/
+
+/* Input Source Structure
+ *
+ * NOTE Exactly one of stream and string is in use. String sources are
+ *      read in place by advancing the cursor; no FILE is ever opened.
+ */
+typedef struct input_s {
+	FILE *stream;
+	const char *cursor;
+	} input_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Input Source Functions */
+void input_init_stream(input_t *input, FILE *stream);
+void input_init_string(input_t *input, const char *string);
+
+/* Input Functions */
+int read_data(FILE *stream, char *buffer, int buffer_size);
+int read_string_data(const char **cursor, char *buffer, int buffer_size);
+int input_pending(input_t *input);
+int input_read_line(input_t *input, char *buffer, int buffer_size);
@@ -18,65 +18,305 @@
 
 /***** Includes *************************************************************/
 
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 #include "expression.h"
+#include "filter.h"
 #include "interpreter.h"
+#include "memo.h"
+#include "pathhash.h"
+#include "placement.h"
+#include "supervisor.h"
 #include "tmnsh.h"
 
 
+/***** Globals **************************************************************/
+
+/* Idle Hook - Work to do while waiting on a foreground child. */
+static int (*idle_hook)(void *data) = NULL;
+static void *idle_hook_data = NULL;
+
+
 /***** Interpreter **********************************************************/
 
 /**
- * void interpret_expression(expression_t *expr)
+ * void interpret_set_idle_hook(int (*hook)(void *data), void *data)
  *
- * Given an expression, this function will execute each command in the
- * expression before either waiting for all the commands to finish or
- * returning immediately (if the expression's background flag is TRUE).
+ * Sets a hook for interpret_wait() to call repeatedly, with the given
+ * data, while a foreground child is still running. The hook must return
+ * FALSE once it has no more work to do. Passing NULL removes the hook.
  */
-void interpret_expression(expression_t *expr) {
-	int builtin_run;
-	int index;
+void interpret_set_idle_hook(int (*hook)(void *data), void *data) {
+	idle_hook = hook;
+	idle_hook_data = data;
+}
+
+/**
+ * int interpret_expression(expression_t *expr)
+ *
+ * Given an expression, this function will execute the command (or the
+ * pipeline of commands, see interpret_pipeline()) in the expression
+ * before either waiting for it to finish or returning immediately (if
+ * the expression's background flag is TRUE).
+ *
+ * NOTE If the expression's tail flag is TRUE the shell has nothing left
+ *      to do afterwards, so a single foreground command replaces the
+ *      shell with execvp() rather than being forked and waited for.
+ * NOTE A foreground memo command is run by the shell itself, so that a
+ *      stored result is replayed without forking at all.
+ *
+ * Returns the exit status of the command waited for (or of the builtin
+ * command run), or 0 if no command was waited for.
+ */
+int interpret_expression(expression_t *expr) {
+	command_t *cmd = expr->cmds[0];
+	placement_t placement;
+	double timeout;
+	char **argv;
+	int status;
 	pid_t pid;
 	
-	for (index = 0; index < expr->num_cmds; index++) {
-		builtin_run = interpret_builtin_command(expr->cmds[index]);
+	if (expr->num_cmds > 1) {
+		return interpret_pipeline(expr);
+	}
+	
+	if (memo_command(cmd) && !expr->background) {
+		return memo_run(cmd, STDIN_FILENO, STDOUT_FILENO);
+	} else if (memo_command(cmd)) {
+		interpret_memo_process(cmd, STDIN_FILENO, STDOUT_FILENO, TRUE);
+		return 0;
+	}
+	
+	if (interpret_builtin_command(cmd, &status) == TRUE) {
+		return status;
+	}
+	
+	if (expr->background) {
+		placement = *placement_background();
+	} else {
+		placement_init(&placement);
+	}
+	
+	argv = interpret_prefix(cmd->argv, &placement, &timeout);
+	
+	if (expr->tail && !expr->background && timeout < 0) {
+		/* As a failed child would. */
+		exit(interpret_exec(argv, &placement));
+	}
+	
+	pid = interpret_run(argv, &placement, timeout, STDIN_FILENO,
+			STDOUT_FILENO, STDERR_FILENO, expr->background);
+	
+	if (expr->background) {
+		return 0;
+	}
+	
+	return interpret_wait(pid);
+}
+
+/**
+ * int interpret_pipeline(expression_t *expr)
+ *
+ * Runs every command in the expression at once, connecting the standard
+ * output of each command to the standard input of the next with a pipe.
+ *
+ * NOTE Commands which filter_create() recognises are run on a thread in
+ *      the shell (or, in the background, in a forked copy of the shell)
+ *      instead of being exec'd. Builtin commands are still run by the
+ *      shell itself and neither read from nor write to the pipeline,
+ *      except for exec, whose command is run as a stage of its own (see
+ *      interpret_command()) rather than replacing the shell midway.
+ *
+ * Returns the exit status of the last command in the pipeline, or 0 if
+ * the expression is run in the background.
+ */
+int interpret_pipeline(expression_t *expr) {
+	filter_t *filters[EXPRESSION_MAX_CMDS];
+	pid_t pids[EXPRESSION_MAX_CMDS];
+	int statuses[EXPRESSION_MAX_CMDS];
+	command_t *cmd;
+	int in_fd = STDIN_FILENO;
+	int out_fd;
+	int next_fd;
+	int fds[2];
+	int index;
+	int num_started;
+	int status = 0;
+	
+	for (num_started = 0; num_started < expr->num_cmds; num_started++) {
+		cmd = expr->cmds[num_started];
+		filters[num_started] = NULL;
+		pids[num_started] = -1;
+		statuses[num_started] = 0;
+		out_fd = STDOUT_FILENO;
+		next_fd = -1;
 		
-		if (builtin_run == TRUE) {
-			continue;
+		if (num_started < expr->num_cmds-1) {
+			if (pipe2(fds, O_CLOEXEC) == -1) {
+				printf("!tmnsh: pipe - %s (%d)\n", strerror(errno), errno);
+				interpret_close(in_fd);
+				break;
+			}
+			
+			/* Fewer, larger transfers between stages; best effort. */
+			fcntl(fds[1], F_SETPIPE_SZ, INTERPRET_PIPE_SIZE);
+			next_fd = fds[0];
+			out_fd = fds[1];
 		}
 		
-		pid = interpret_command(expr->cmds[index]);
-		if (!expr->background) {
-			waitpid(pid, NULL, 0);
+		if (memo_command(cmd)) {
+			pids[num_started] = interpret_memo_process(cmd, in_fd, out_fd,
+					expr->background);
+			interpret_close(in_fd);
+			interpret_close(out_fd);
+		} else if (!interpret_exec_stage(cmd) &&
+				interpret_builtin_command(cmd,
+				&statuses[num_started]) == TRUE) {
+			interpret_close(in_fd);
+			interpret_close(out_fd);
+		} else if ((filters[num_started] = filter_create(cmd)) == NULL) {
+			pids[num_started] = interpret_command(cmd, in_fd, out_fd,
+					STDERR_FILENO, expr->background);
+			interpret_close(in_fd);
+			interpret_close(out_fd);
+		} else if (expr->background ||
+				filter_start(filters[num_started], in_fd, out_fd) == -1) {
+			pids[num_started] = interpret_filter_process(filters[num_started],
+					in_fd, out_fd, expr->background);
+			filter_destroy(filters[num_started]);
+			filters[num_started] = NULL;
+			interpret_close(in_fd);
+			interpret_close(out_fd);
+		}
+		
+		in_fd = next_fd;
+	}
+	
+	for (index = 0; index < num_started; index++) {
+		if (filters[index] != NULL) {
+			status = filter_join(filters[index]);
+			filter_destroy(filters[index]);
+		} else if (pids[index] != -1 && !expr->background) {
+			status = interpret_wait(pids[index]);
+		} else {
+			status = statuses[index];
 		}
 	}
+	
+	if (expr->background) {
+		return 0;
+	}
+	
+	return status;
+}
+
+/**
+ * int interpret_exec_stage(command_t *cmd)
+ *
+ * Returns TRUE if the given command is the exec builtin with a command
+ * to run, which in a pipeline is run as an ordinary stage rather than
+ * replacing the shell, FALSE otherwise.
+ */
+int interpret_exec_stage(command_t *cmd) {
+	return (strcasecmp(cmd->argv[0], "exec") == 0 && cmd->num_args > 1);
+}
+
+/**
+ * int interpret_wait(pid_t pid)
+ *
+ * Waits for the given child process to finish, calling the idle hook
+ * (if any) until either the child finishes or the hook runs out of work.
+ * Children are waited for through the supervisor's event loop if it is
+ * active, or with waitpid() otherwise (i.e. on the "-c" startup path).
+ *
+ * Returns the child's exit status (see supervisor_exit_status()).
+ */
+int interpret_wait(pid_t pid) {
+	int status;
+	pid_t result = 0;
+	
+	if (supervisor_active()) {
+		return supervisor_wait(pid, idle_hook, idle_hook_data);
+	}
+	
+	while (result == 0 && idle_hook != NULL && idle_hook(idle_hook_data)) {
+		result = waitpid(pid, &status, WNOHANG);
+	}
+	
+	if (result == 0) {
+		result = waitpid(pid, &status, 0);
+	}
+	
+	if (result == -1) {
+		return 0;
+	}
+	
+	return supervisor_exit_status(status);
 }
 
 /**
- * int interpret_builtin_command(command_t *cmd)
+ * int interpret_builtin_command(command_t *cmd, int *status)
+ *
+ * Runs the given command if it is a builtin, placing its exit status in
+ * *status: 0 if it succeeded, non-zero otherwise.
  *
  * Returns TRUE if a builtin command is found and executed. FALSE
  * otherwise.
  */
-int interpret_builtin_command(command_t *cmd) {
+int interpret_builtin_command(command_t *cmd, int *status) {
+	placement_t placement;
+	char **argv;
 	int result;
 	
+	*status = 0;
+	
 	/* cd - The change directory command. */
 	if (strcasecmp(cmd->argv[0], "cd") == 0) {
 		result = chdir(cmd->argv[1]);
 		
 		if (result == -1) {
 			printf("!tmnsh: cd - %s (%d)\n", strerror(errno), errno);
+			*status = 1;
+		}
+		
+		return TRUE; /* Builtin command found. */
+	}
+	
+	/* exec - Replace the shell with the given command. */
+	if (strcasecmp(cmd->argv[0], "exec") == 0) {
+		if (cmd->num_args > 1) {
+			placement_init(&placement);
+			argv = interpret_prefix(&cmd->argv[1], &placement, NULL);
+			*status = interpret_exec(argv, &placement);
 		}
 		
 		return TRUE; /* Builtin command found. */
 	}
 	
+	/* background - Set how background jobs are placed. */
+	if (strcasecmp(cmd->argv[0], "background") == 0) {
+		*status = placement_background_command(cmd);
+		return TRUE; /* Builtin command found. */
+	}
+	
+	/* cgroup - Create and configure a cgroup for jobs. */
+	if (strcasecmp(cmd->argv[0], "cgroup") == 0) {
+		*status = placement_cgroup_command(cmd);
+		return TRUE; /* Builtin command found. */
+	}
+	
 	/* quit - The quit command. */
 	if (strcasecmp(cmd->argv[0], "quit") == 0) {
 		exit(0);
@@ -87,30 +327,471 @@ int interpret_builtin_command(command_t *cmd) {
 }
 
 /**
- * pid_t interpret_command(command_t *cmd)
+ * double interpret_timeout(char *argv[])
+ *
+ * Checks whether the given command is of the form "timeout duration
+ * command [args...]", where duration is a number of seconds optionally
+ * followed by one of the suffixes s, m, h or d (as in coreutils).
+ *
+ * Returns the duration in seconds, or -1 if the command is not of that
+ * form (in which case any real timeout command is run as normal).
+ */
+double interpret_timeout(char *argv[]) {
+	double seconds;
+	char *end;
+	
+	if (argv[0] == NULL || strcmp(argv[0], "timeout") != 0 ||
+			argv[1] == NULL || argv[2] == NULL ||
+			argv[1][0] < '0' || argv[1][0] > '9') {
+		return -1;
+	}
+	
+	seconds = strtod(argv[1], &end);
+	
+	if (*end == 'm') {
+		seconds *= 60;
+	} else if (*end == 'h') {
+		seconds *= 60 * 60;
+	} else if (*end == 'd') {
+		seconds *= 60 * 60 * 24;
+	} else if (*end != 's' && *end != '\0') {
+		return -1;
+	}
+	
+	if (*end != '\0' && end[1] != '\0') {
+		return -1;
+	}
+	
+	return seconds;
+}
+
+/**
+ * char **interpret_prefix(char *argv[], placement_t *placement,
+ *                         double *timeout)
+ *
+ * Strips the wrapper commands which the shell handles itself from the
+ * front of the given command, in any order: "timeout duration" (see
+ * interpret_timeout()) and the placement wrappers "nice", "taskset -c",
+ * "ionice" and "cgexec -g" (see placement_parse()). Their settings are
+ * added to the placement and *timeout, which is -1 if there is none.
+ *
+ * NOTE A wrapper is only stripped if a command follows it. If timeout is
+ *      NULL, or the supervisor cannot be started, a timeout prefix (and
+ *      anything after it) is left to the real timeout command.
+ *
+ * Returns the rest of the command.
+ */
+char **interpret_prefix(char *argv[], placement_t *placement,
+		double *timeout) {
+	placement_t parsed;
+	int used;
+	
+	if (timeout != NULL) {
+		*timeout = -1;
+	}
+	
+	while (argv[0] != NULL) {
+		parsed = *placement;
+		
+		if ((used = placement_parse(argv, &parsed)) > 0) {
+			if (argv[used] == NULL) {
+				break;
+			}
+			
+			*placement = parsed;
+			argv += used;
+		} else if (timeout != NULL && *timeout < 0 &&
+				interpret_timeout(argv) >= 0 && supervisor_init() == 0) {
+			*timeout = interpret_timeout(argv);
+			argv += 2;
+		} else {
+			break;
+		}
+	}
+	
+	return argv;
+}
+
+/**
+ * pid_t interpret_command(command_t *cmd, int in_fd, int out_fd,
+ *                         int err_fd, int background)
  *
  * Creates a child process by calling fork() and then runs the given
- * command in that child process by calling execvp().
+ * command in that child process by calling execvp(), with in_fd, out_fd
+ * and err_fd as its standard input, output and error. The child is
+ * handed to the supervisor as a foreground or background job.
+ *
+ * NOTE A "timeout duration" prefix (see interpret_timeout()) is handled
+ *      here rather than by running the coreutils timeout command: the
+ *      rest of the command is run directly and the supervisor sends it
+ *      SIGTERM once the duration is up.
+ * NOTE Likewise the nice, taskset, ionice and cgexec prefixes (see
+ *      interpret_prefix()) are applied by the child itself before it
+ *      calls execvp(), on top of the background placement for background
+ *      jobs, so no wrapper process is run.
+ * NOTE An exec pipeline stage (see interpret_exec_stage()) runs its
+ *      command here, as a subshell would, so only the stage is replaced.
  *
  * Returns the ID of the child process running the given command.
  */
-pid_t interpret_command(command_t *cmd) {
+pid_t interpret_command(command_t *cmd, int in_fd, int out_fd,
+		int err_fd, int background) {
+	placement_t placement;
+	double timeout;
+	char **argv = cmd->argv;
+	
+	if (background) {
+		placement = *placement_background();
+	} else {
+		placement_init(&placement);
+	}
+	
+	if (interpret_exec_stage(cmd)) {
+		argv++;
+	}
+	
+	argv = interpret_prefix(argv, &placement, &timeout);
+	
+	return interpret_run(argv, &placement, timeout, in_fd, out_fd, err_fd,
+			background);
+}
+
+/**
+ * pid_t interpret_run(char *argv[], const placement_t *placement,
+ *                     double timeout, int in_fd, int out_fd, int err_fd,
+ *                     int background)
+ *
+ * Does the work of interpret_command() for a command whose prefixes
+ * have already been stripped by interpret_prefix(), so that they are
+ * only parsed (and any error in them only reported) once.
+ *
+ * NOTE The command is looked up in the path hash before forking, so
+ *      that the shell (rather than the short-lived child) remembers
+ *      where it was found.
+ *
+ * Returns the ID of the child process running the given command.
+ */
+pid_t interpret_run(char *argv[], const placement_t *placement,
+		double timeout, int in_fd, int out_fd, int err_fd, int background) {
+	const char *path;
 	int result;
 	pid_t pid;
 	
+	path = pathhash_lookup(argv[0]);
+	
+	fflush(stdout); /* Don't let the child inherit buffered output. */
+	
 	pid = fork();
 	if (pid == 0) {
-		result = execvp(cmd->argv[0], cmd->argv);
+		supervisor_child();
+		interpret_redirect(in_fd, out_fd, err_fd);
 		
-		if (result == -1) {
-			printf("!tmnsh: %s - %s (%d)\n", cmd->argv[0], strerror(errno),
-			 		errno);
+		if (placement_apply(placement) == -1) {
+			exit(1);
 		}
 		
-		exit(1); /* This will exit the CHILD process. */
+		interpret_execv(path, argv);
+		result = interpret_exec_status(errno);
+		
+		printf("!tmnsh: %s - %s (%d)\n", argv[0], strerror(errno), errno);
+		
+		exit(result); /* This will exit the CHILD process. */
 		
 		return pid;
 	} else {
+		supervisor_add(pid, background);
+		
+		if (timeout >= 0) {
+			supervisor_set_timeout(pid, timeout);
+		}
+		
 		return pid;
 	}
 }
+
+/**
+ * pid_t interpret_filter_process(filter_t *filter, int in_fd, int out_fd,
+ *                                int background)
+ *
+ * Creates a child process by calling fork() and runs the given filter
+ * in that child process from in_fd to out_fd. Every other descriptor is
+ * closed in the child (see interpret_close_others()). The child is
+ * handed to the supervisor as a foreground or background job, and a
+ * background child is placed as the background builtin asks.
+ *
+ * Returns the ID of the child process running the given filter.
+ */
+pid_t interpret_filter_process(filter_t *filter, int in_fd, int out_fd,
+		int background) {
+	pid_t pid;
+	
+	fflush(stdout); /* Don't let the child inherit buffered output. */
+	
+	pid = fork();
+	if (pid == 0) {
+		supervisor_child();
+		interpret_close_others(in_fd, out_fd);
+		
+		if (background && placement_apply(placement_background()) == -1) {
+			fflush(stdout);
+			_exit(1);
+		}
+		
+		_exit(filter_run(filter, in_fd, out_fd));
+	}
+	
+	supervisor_add(pid, background);
+	
+	return pid;
+}
+
+/**
+ * pid_t interpret_memo_process(command_t *cmd, int in_fd, int out_fd,
+ *                              int background)
+ *
+ * Creates a child process by calling fork() and runs the given memo
+ * command (see memo_run()) in that child process from in_fd to out_fd,
+ * so that it can take part in a pipeline or run in the background.
+ * Every other descriptor is closed in the child (see
+ * interpret_close_others()). A background child is placed as the
+ * background builtin asks, and the command it runs inherits that
+ * placement.
+ *
+ * Returns the ID of the child process running the given command.
+ */
+pid_t interpret_memo_process(command_t *cmd, int in_fd, int out_fd,
+		int background) {
+	pid_t pid;
+	
+	fflush(stdout); /* Don't let the child inherit buffered output. */
+	
+	pid = fork();
+	if (pid == 0) {
+		supervisor_child();
+		interpret_set_idle_hook(NULL, NULL); /* The input is the shell's. */
+		interpret_close_others(in_fd, out_fd);
+		
+		if (background && placement_apply(placement_background()) == -1) {
+			fflush(stdout);
+			_exit(1);
+		}
+		
+		_exit(memo_run(cmd, in_fd, out_fd));
+	}
+	
+	supervisor_add(pid, background);
+	
+	return pid;
+}
+
+/**
+ * void interpret_redirect(int in_fd, int out_fd, int err_fd)
+ *
+ * Makes the given descriptors the standard input, output and error of
+ * the calling process, closing the originals.
+ */
+void interpret_redirect(int in_fd, int out_fd, int err_fd) {
+	if (in_fd != STDIN_FILENO) {
+		dup2(in_fd, STDIN_FILENO);
+		close(in_fd);
+	}
+	
+	if (out_fd != STDOUT_FILENO) {
+		dup2(out_fd, STDOUT_FILENO);
+		close(out_fd);
+	}
+	
+	if (err_fd != STDERR_FILENO) {
+		dup2(err_fd, STDERR_FILENO);
+		close(err_fd);
+	}
+}
+
+/**
+ * void interpret_close(int fd)
+ *
+ * Closes one end of a pipe. Standard input, output and error (and -1,
+ * meaning no descriptor) are left alone.
+ */
+void interpret_close(int fd) {
+	if (fd > STDERR_FILENO) {
+		close(fd);
+	}
+}
+
+/**
+ * void interpret_close_others(int in_fd, int out_fd)
+ *
+ * Closes every descriptor other than standard input, output and error
+ * and the two given. This is for children which run part of a pipeline
+ * in a copy of the shell: they never call execvp(), so close-on-exec
+ * pipes still held by the shell (i.e. by filter threads or for the next
+ * stage) would stay open in them and keep readers from seeing EOF.
+ */
+void interpret_close_others(int in_fd, int out_fd) {
+	DIR *dir = opendir("/proc/self/fd");
+	struct dirent *file;
+	int fd;
+	
+	if (dir == NULL) {
+		return;
+	}
+	
+	while ((file = readdir(dir)) != NULL) {
+		fd = atoi(file->d_name);
+		
+		if (fd > STDERR_FILENO && fd != in_fd && fd != out_fd &&
+				fd != dirfd(dir)) {
+			close(fd);
+		}
+	}
+	
+	closedir(dir);
+}
+
+/**
+ * int interpret_exec(char *argv[], const placement_t *placement)
+ *
+ * Replaces the shell process with the given command by calling execvp()
+ * without forking first. Any buffered output is flushed beforehand, as
+ * it would otherwise be lost along with the shell's memory. The command
+ * has had its prefixes stripped by interpret_prefix(), and the given
+ * placement is applied to the shell itself just before it is replaced.
+ *
+ * NOTE The command is checked (see interpret_runnable()) before the
+ *      placement is applied, and should execvp() fail anyway the
+ *      placement is undone (see placement_save()), so a failed exec
+ *      leaves the shell placed as it was.
+ * NOTE This function only returns if execvp() fails, after printing an
+ *      error message.
+ *
+ * Returns the exit status for the failure (see interpret_exec_status()).
+ */
+int interpret_exec(char *argv[], const placement_t *placement) {
+	placement_t saved;
+	const char *path;
+	int error;
+	
+	path = pathhash_lookup(argv[0]);
+	
+	fflush(stdout);
+	
+	if (!interpret_runnable(argv[0], path)) {
+		error = errno;
+		printf("!tmnsh: %s - %s (%d)\n", argv[0], strerror(error), error);
+		return interpret_exec_status(error);
+	}
+	
+	placement_save(placement, &saved);
+	
+	if (placement_apply(placement) == -1) {
+		placement_apply(&saved);
+		return 1;
+	}
+	
+	supervisor_exec_begin();
+	
+	interpret_execv(path, argv);
+	error = errno;
+	
+	supervisor_exec_failed(); /* Carry on supervising the shell's jobs. */
+	placement_apply(&saved);
+	printf("!tmnsh: %s - %s (%d)\n", argv[0], strerror(error), error);
+	
+	return interpret_exec_status(error);
+}
+
+/**
+ * int interpret_runnable(const char *name, const char *path)
+ *
+ * Checks, without running it, that execvp() would find an executable
+ * regular file for the given command name: the path found for it by
+ * pathhash_lookup() if there is one, the name itself if it contains a
+ * slash, or else the first such file in the PATH directories.
+ *
+ * Returns TRUE if so, FALSE (with errno set to ENOENT, or to EACCES if
+ * something was found but cannot be run) if not.
+ */
+int interpret_runnable(const char *name, const char *path) {
+	char file[PATHHASH_PATH_MAX_SIZE];
+	const char *dirs = getenv("PATH");
+	struct stat st;
+	int error = ENOENT;
+	size_t length;
+	
+	if (path != NULL) {
+		return TRUE;
+	}
+	
+	if (strchr(name, '/') != NULL) {
+		dirs = ""; /* Only the name itself. */
+	} else if (dirs == NULL) {
+		dirs = "/bin:/usr/bin"; /* As execvp() searches. */
+	}
+	
+	for (;;) {
+		length = strcspn(dirs, ":");
+		
+		if (strchr(name, '/') != NULL) {
+			snprintf(file, PATHHASH_PATH_MAX_SIZE, "%s", name);
+		} else {
+			snprintf(file, PATHHASH_PATH_MAX_SIZE, "%.*s%s%s", (int)length,
+					dirs, (length > 0 ? "/" : ""), name);
+		}
+		
+		if (stat(file, &st) == 0) {
+			if (S_ISREG(st.st_mode) && access(file, X_OK) == 0) {
+				return TRUE;
+			}
+			
+			error = EACCES;
+		}
+		
+		if (dirs[length] == '\0') {
+			break;
+		}
+		
+		dirs = &dirs[length + 1];
+	}
+	
+	errno = error;
+	
+	return FALSE;
+}
+
+/**
+ * int interpret_exec_status(int error)
+ *
+ * Returns the exit status for a command which could not be exec'd with
+ * the given errno: 127 if it was not found, 126 if it was found but
+ * could not be run (as with /bin/sh).
+ */
+int interpret_exec_status(int error) {
+	if (error == ENOENT || error == ENOTDIR) {
+		return INTERPRET_NOT_FOUND_STATUS;
+	}
+	
+	return INTERPRET_CANNOT_EXEC_STATUS;
+}
+
+/**
+ * int interpret_execv(const char *path, char *argv[])
+ *
+ * Runs the given command by calling execv() on the path found for it by
+ * pathhash_lookup(). If there is no path, the executable has gone since
+ * it was found or it is a script without a "#!" line (ENOEXEC),
+ * execvp() is called instead, which runs such scripts with /bin/sh.
+ *
+ * Returns -1, and only if the command could not be run at all.
+ */
+int interpret_execv(const char *path, char *argv[]) {
+	if (path != NULL) {
+		execv(path, argv);
+		
+		if (errno != ENOENT && errno != ENOTDIR && errno != ENOEXEC) {
+			return -1;
+		}
+	}
+	
+	return execvp(argv[0], argv);
+}
@@ -16,8 +16,40 @@
  *
  ****************************************************************************/
 
+/***** Defines **************************************************************/
+
+#define INTERPRET_PIPE_SIZE 1048576
+#define INTERPRET_SYNTAX_STATUS 2
+#define INTERPRET_CANNOT_EXEC_STATUS 126
+#define INTERPRET_NOT_FOUND_STATUS 127
+
+
 /***** Function Declarations ************************************************/
 
-void interpret_expression(expression_t *expr);
-int interpret_builtin_command(command_t *cmd);
-pid_t interpret_command(command_t *cmd);
+struct filter_s;
+struct placement_s;
+
+void interpret_set_idle_hook(int (*hook)(void *data), void *data);
+int interpret_expression(expression_t *expr);
+int interpret_pipeline(expression_t *expr);
+int interpret_exec_stage(command_t *cmd);
+int interpret_wait(pid_t pid);
+int interpret_builtin_command(command_t *cmd, int *status);
+double interpret_timeout(char *argv[]);
+char **interpret_prefix(char *argv[], struct placement_s *placement,
+		double *timeout);
+pid_t interpret_command(command_t *cmd, int in_fd, int out_fd,
+		int err_fd, int background);
+pid_t interpret_run(char *argv[], const struct placement_s *placement,
+		double timeout, int in_fd, int out_fd, int err_fd, int background);
+pid_t interpret_filter_process(struct filter_s *filter, int in_fd,
+		int out_fd, int background);
+pid_t interpret_memo_process(command_t *cmd, int in_fd, int out_fd,
+		int background);
+void interpret_redirect(int in_fd, int out_fd, int err_fd);
+void interpret_close(int fd);
+void interpret_close_others(int in_fd, int out_fd);
+int interpret_exec(char *argv[], const struct placement_s *placement);
+int interpret_runnable(const char *name, const char *path);
+int interpret_exec_status(int error);
+int interpret_execv(const char *path, char *argv[]);
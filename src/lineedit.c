@@ -0,0 +1,674 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "complete.h"
+#include "history.h"
+#include "lineedit.h"
+#include "supervisor.h"
+#include "tmnsh.h"
+
+
+/***** Terminal Functions ***************************************************/
+
+/**
+ * void lineedit_write(const char *data, int size)
+ *
+ * Writes the given data to the terminal, straight to the standard output
+ * descriptor so that it is not held in stdio's buffer.
+ */
+static void lineedit_write(const char *data, int size) {
+	int written;
+	
+	while (size > 0) {
+		written = write(STDOUT_FILENO, data, size);
+		
+		if (written == -1 && errno == EINTR) {
+			continue;
+		} else if (written <= 0) {
+			return;
+		}
+		
+		data += written;
+		size -= written;
+	}
+}
+
+/**
+ * int lineedit_byte()
+ *
+ * Reads a single byte from the terminal.
+ *
+ * Returns the byte read, or -1 at EOF or on error.
+ */
+static int lineedit_byte() {
+	unsigned char byte;
+	int result;
+	
+	do {
+		result = read(STDIN_FILENO, &byte, 1);
+	} while (result == -1 && errno == EINTR);
+	
+	return (result == 1) ? byte : -1;
+}
+
+/**
+ * int lineedit_ready()
+ *
+ * Returns TRUE if there is input waiting at the terminal, FALSE
+ * otherwise.
+ */
+static int lineedit_ready() {
+	struct pollfd fds;
+	
+	fds.fd = STDIN_FILENO;
+	fds.events = POLLIN;
+	
+	return poll(&fds, 1, 0) > 0;
+}
+
+/**
+ * int lineedit_key(lineedit_t *edit)
+ *
+ * Reads a key from the terminal, waiting in the supervisor's event loop
+ * (if it is active) so that background jobs are still looked after.
+ * The escape sequences sent by the arrow, home, end and delete keys are
+ * turned into the LINEEDIT_KEY_* codes.
+ *
+ * NOTE Until a key arrives, the history's search index is built a few
+ *      thousand entries at a time, so that a large history is usually
+ *      indexed before the user ever presses ^R.
+ *
+ * Returns the key read, or -1 at EOF or on error.
+ */
+static int lineedit_key(lineedit_t *edit) {
+	history_t *history = edit->history;
+	int key;
+	int final;
+	
+	while (history != NULL && history->num_indexed < history->num_entries &&
+			lineedit_ready() == FALSE) {
+		if (history_index(history, LINEEDIT_INDEX_STEP) == -1) {
+			break;
+		}
+	}
+	
+	if (supervisor_active()) {
+		supervisor_wait_input(STDIN_FILENO);
+	}
+	
+	key = lineedit_byte();
+	
+	if (key != 27) {
+		return key;
+	}
+	
+	key = lineedit_byte();
+	
+	if (key != '[' && key != 'O') {
+		return 27;
+	}
+	
+	key = lineedit_byte();
+	
+	switch (key) {
+		case 'A':
+			return LINEEDIT_KEY_UP;
+		case 'B':
+			return LINEEDIT_KEY_DOWN;
+		case 'C':
+			return LINEEDIT_KEY_RIGHT;
+		case 'D':
+			return LINEEDIT_KEY_LEFT;
+		case 'H':
+			return LINEEDIT_KEY_HOME;
+		case 'F':
+			return LINEEDIT_KEY_END;
+	}
+	
+	if (key < '0' || key > '9') {
+		return 27;
+	}
+	
+	final = lineedit_byte();
+	
+	if (final != '~') {
+		return 27;
+	} else if (key == '1' || key == '7') {
+		return LINEEDIT_KEY_HOME;
+	} else if (key == '4' || key == '8') {
+		return LINEEDIT_KEY_END;
+	} else if (key == '3') {
+		return LINEEDIT_KEY_DELETE;
+	}
+	
+	return 27;
+}
+
+
+/***** Editing Functions ****************************************************/
+
+/**
+ * void lineedit_draw(lineedit_t *edit, const char *prefix)
+ *
+ * Redraws the line being edited after the given prefix (the prompt, or
+ * the search prompt) and puts the cursor in its place, in one write.
+ *
+ * NOTE Lines are assumed to fit on one row of the terminal, and every
+ *      byte is assumed to take one column.
+ */
+static void lineedit_draw(lineedit_t *edit, const char *prefix) {
+	char *screen = edit->screen;
+	int size = sprintf(screen, "\r%s", prefix);
+	
+	memcpy(screen + size, edit->buffer, edit->length);
+	size += edit->length;
+	size += sprintf(screen + size, "\x1b[K");
+	
+	if (edit->position < edit->length) {
+		size += sprintf(screen + size, "\x1b[%dD",
+				edit->length - edit->position);
+	}
+	
+	lineedit_write(screen, size);
+}
+
+/**
+ * void lineedit_set(lineedit_t *edit, const char *text,
+ *                   unsigned long length)
+ *
+ * Replaces the line being edited with the given text, truncating it to
+ * fit, and moves the cursor to its end.
+ */
+static void lineedit_set(lineedit_t *edit, const char *text,
+		unsigned long length) {
+	if (length > edit->buffer_size - 1) {
+		length = edit->buffer_size - 1;
+	}
+	
+	memmove(edit->buffer, text, length);
+	edit->buffer[length] = '\0';
+	edit->length = length;
+	edit->position = length;
+}
+
+/**
+ * void lineedit_insert(lineedit_t *edit, char character)
+ *
+ * Inserts the given character at the cursor, if there is room for it.
+ */
+static void lineedit_insert(lineedit_t *edit, char character) {
+	if (edit->length >= edit->buffer_size - 1) {
+		return;
+	}
+	
+	memmove(edit->buffer + edit->position + 1, edit->buffer + edit->position,
+			edit->length - edit->position + 1);
+	edit->buffer[edit->position++] = character;
+	edit->length++;
+}
+
+/**
+ * void lineedit_delete(lineedit_t *edit, int start, int end)
+ *
+ * Deletes the characters from start up to (but not including) end and
+ * moves the cursor to where they were.
+ */
+static void lineedit_delete(lineedit_t *edit, int start, int end) {
+	memmove(edit->buffer + start, edit->buffer + end,
+			edit->length - end + 1);
+	edit->length -= end - start;
+	edit->position = start;
+}
+
+/**
+ * void lineedit_history(lineedit_t *edit, int entry)
+ *
+ * Replaces the line being edited with the given history entry, or with
+ * the line that was being typed if entry is the number of entries.
+ */
+static void lineedit_history(lineedit_t *edit, int entry) {
+	history_t *history = edit->history;
+	unsigned long length;
+	const char *text;
+	
+	if (history == NULL || entry < 0 || entry > (int) history->num_entries) {
+		return;
+	}
+	
+	if (edit->entry == history->num_entries) {
+		strcpy(edit->saved, edit->buffer);
+	}
+	
+	edit->entry = entry;
+	
+	if (entry == history->num_entries) {
+		lineedit_set(edit, edit->saved, strlen(edit->saved));
+	} else {
+		text = history_entry(history, entry, &length);
+		lineedit_set(edit, text, length);
+	}
+}
+
+/**
+ * int lineedit_search(lineedit_t *edit)
+ *
+ * Runs a reverse incremental search (^R) through the history. Each key
+ * typed refines the query and shows the most recent entry containing
+ * it; ^R again moves on to older matches. ^G gives up and restores the
+ * line as it was, while any other key accepts the match shown.
+ *
+ * Returns the key which ended the search, for the caller to act on, or
+ * 0 if there is nothing more to do.
+ */
+static int lineedit_search(lineedit_t *edit) {
+	history_t *history = edit->history;
+	char query[BUFFER_MAX_SIZE];
+	char prefix[BUFFER_MAX_SIZE + sizeof(LINEEDIT_FAILED_SEARCH_PROMPT)];
+	char *original;
+	int query_size = 0;
+	int match = history->num_entries;
+	int found = TRUE;
+	int before;
+	int result;
+	int key;
+	unsigned long length;
+	const char *text;
+	
+	original = malloc(edit->buffer_size);
+	
+	if (original == NULL) {
+		return 0;
+	}
+	
+	strcpy(original, edit->buffer);
+	query[0] = '\0';
+	
+	while (TRUE) {
+		sprintf(prefix, found ? LINEEDIT_SEARCH_PROMPT :
+				LINEEDIT_FAILED_SEARCH_PROMPT, query);
+		lineedit_draw(edit, prefix);
+		
+		key = lineedit_key(edit);
+		
+		if (key == 18) {
+			/* ^R - The next older match. */
+			before = match;
+		} else if (key == 127 || key == 8) {
+			if (query_size > 0) {
+				query[--query_size] = '\0';
+			}
+			
+			before = history->num_entries;
+		} else if (key == 7) {
+			/* ^G - Give up. */
+			lineedit_set(edit, original, strlen(original));
+			key = 0;
+			break;
+		} else if (key >= 32 && key < 256 && key != 127) {
+			if (query_size < BUFFER_MAX_SIZE - 1 &&
+					query_size < edit->buffer_size - 1) {
+				query[query_size++] = key;
+				query[query_size] = '\0';
+			}
+			
+			/* The match shown may still contain the longer query. */
+			before = found ? match + 1 : match;
+		} else {
+			break;
+		}
+		
+		if (query_size == 0) {
+			lineedit_set(edit, original, strlen(original));
+			match = history->num_entries;
+			found = TRUE;
+			continue;
+		}
+		
+		result = history_search(history, query, before);
+		found = (result != -1);
+		
+		if (found) {
+			match = result;
+			text = history_entry(history, match, &length);
+			lineedit_set(edit, text, length);
+			
+			text = strstr(edit->buffer, query);
+			edit->position = (text != NULL) ? text - edit->buffer : 0;
+		}
+	}
+	
+	free(original);
+	edit->entry = history->num_entries;
+	
+	return key;
+}
+
+
+/**
+ * void lineedit_list(complete_t *results)
+ *
+ * Lists the given completions below the line being edited, in as many
+ * columns as fit the terminal. Only the last part of each file name is
+ * shown.
+ */
+static void lineedit_list(complete_t *results) {
+	struct winsize window;
+	const char *name;
+	const char *shown;
+	char *screen;
+	int width = 80;
+	int longest = 0;
+	int columns;
+	int length;
+	int size = 0;
+	int i;
+	
+	if (results->num_names > LINEEDIT_MAX_LIST) {
+		screen = malloc(64);
+		
+		if (screen != NULL) {
+			size = sprintf(screen, "\r\n(%d possibilities)\r\n",
+					results->num_names);
+			lineedit_write(screen, size);
+			free(screen);
+		}
+		
+		return;
+	}
+	
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col > 0) {
+		width = window.ws_col;
+	}
+	
+	for (i = 0, name = results->names; i < results->num_names; i++) {
+		length = strlen(name);
+		longest = (length > longest) ? length : longest;
+		name += length + 1;
+	}
+	
+	screen = malloc(results->num_names * (longest + 4) + 8);
+	
+	if (screen == NULL) {
+		return;
+	}
+	
+	columns = width / (longest + 2);
+	columns = (columns > 0) ? columns : 1;
+	size += sprintf(screen, "\r\n");
+	
+	for (i = 0, name = results->names; i < results->num_names; i++) {
+		length = strlen(name);
+		
+		for (shown = name + length - 1; shown > name && shown[-1] != '/';
+				shown--) {
+		}
+		
+		size += sprintf(screen + size, "%s", shown);
+		
+		if ((i + 1) % columns == 0 || i + 1 == results->num_names) {
+			size += sprintf(screen + size, "\r\n");
+		} else {
+			size += sprintf(screen + size, "%*s",
+					(int) (longest + 2 - (name + length - shown)), "");
+		}
+		
+		name += length + 1;
+	}
+	
+	lineedit_write(screen, size);
+	free(screen);
+}
+
+/**
+ * void lineedit_complete(lineedit_t *edit)
+ *
+ * Completes the word before the cursor (TAB). The first word of an
+ * expression is completed as a command name and any other word (or one
+ * containing a slash) as a file name. As much as all the completions
+ * have in common is inserted, followed by a space if there was only one;
+ * otherwise the completions are listed.
+ */
+static void lineedit_complete(lineedit_t *edit) {
+	char word[BUFFER_MAX_SIZE];
+	complete_t results;
+	int start = edit->position;
+	int length;
+	int i;
+	
+	while (start > 0 && edit->buffer[start-1] != ' ' &&
+			edit->buffer[start-1] != ';') {
+		start--;
+	}
+	
+	length = edit->position - start;
+	memcpy(word, edit->buffer + start, length);
+	word[length] = '\0';
+	
+	/* The first word, or the first after a pipe or semicolon. */
+	for (i = start; i > 0 && edit->buffer[i-1] == ' '; i--) {
+	}
+	
+	complete_init(&results);
+	
+	if ((i == 0 || edit->buffer[i-1] == '|' || edit->buffer[i-1] == ';') &&
+			strchr(word, '/') == NULL) {
+		complete_command(word, &results);
+	} else {
+		complete_file(word, &results);
+	}
+	
+	if (results.num_names == 0) {
+		lineedit_write("\a", 1);
+	} else if (results.num_names == 1) {
+		for (i = length; i < results.common; i++) {
+			lineedit_insert(edit, results.names[i]);
+		}
+		
+		if (results.names[results.common - 1] != '/') {
+			lineedit_insert(edit, ' ');
+		}
+	} else if (results.common > length) {
+		for (i = length; i < results.common; i++) {
+			lineedit_insert(edit, results.names[i]);
+		}
+	} else {
+		lineedit_list(&results);
+	}
+	
+	complete_free(&results);
+}
+
+
+/***** Line Editor Functions ************************************************/
+
+/**
+ * int lineedit_read(struct history_s *history, const char *prompt,
+ *                   char *buffer, int buffer_size)
+ *
+ * Shows the given prompt and reads a line from the terminal into the
+ * buffer supplied, with the usual emacs-style editing keys: arrows, ^A,
+ * ^E, ^B, ^F, ^K, ^U, ^L, up/down (or ^P/^N) through the history, ^R
+ * to search it and TAB to complete command and file names. ^C abandons
+ * the line and ^D on an empty line is EOF. The history may be NULL.
+ *
+ * NOTE The terminal is only in raw mode while a line is being read, so
+ *      commands always run with the user's own terminal settings.
+ *
+ * Returns TRUE if a line was read, FALSE at EOF (the buffer is empty).
+ */
+int lineedit_read(struct history_s *history, const char *prompt,
+		char *buffer, int buffer_size) {
+	struct termios original;
+	struct termios raw;
+	lineedit_t edit;
+	int more_to_read = TRUE;
+	int done = FALSE;
+	int key;
+	
+	buffer[0] = '\0';
+	
+	if (tcgetattr(STDIN_FILENO, &original) == -1) {
+		return FALSE;
+	}
+	
+	edit.prompt = prompt;
+	edit.buffer = buffer;
+	edit.buffer_size = buffer_size;
+	edit.length = 0;
+	edit.position = 0;
+	edit.history = history;
+	edit.entry = 0;
+	edit.saved = malloc(buffer_size);
+	edit.screen = malloc(strlen(prompt) + 2 * buffer_size +
+			sizeof(LINEEDIT_FAILED_SEARCH_PROMPT) + 32);
+	
+	if (edit.saved == NULL || edit.screen == NULL) {
+		free(edit.saved);
+		free(edit.screen);
+		return FALSE;
+	}
+	
+	edit.saved[0] = '\0';
+	
+	if (history != NULL) {
+		history_refresh(history);
+		edit.entry = history->num_entries;
+	}
+	
+	complete_update();
+	
+	raw = original;
+	raw.c_iflag &= ~(ICRNL | IXON);
+	raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+	
+	while (done == FALSE) {
+		lineedit_draw(&edit, prompt);
+		key = lineedit_key(&edit);
+		
+		if (key == 18 && history != NULL) {
+			key = lineedit_search(&edit);
+		}
+		
+		switch (key) {
+			case -1:
+				/* EOF - Whatever was typed is lost. */
+				lineedit_set(&edit, "", 0);
+				more_to_read = FALSE;
+				done = TRUE;
+				break;
+			case '\r':
+			case '\n':
+				done = TRUE;
+				break;
+			case 4: /* ^D */
+				if (edit.length == 0) {
+					more_to_read = FALSE;
+					done = TRUE;
+				} else if (edit.position < edit.length) {
+					lineedit_delete(&edit, edit.position, edit.position + 1);
+				}
+				break;
+			case 3: /* ^C */
+				lineedit_write("^C\r\n", 4);
+				lineedit_set(&edit, "", 0);
+				edit.entry = (history != NULL) ? history->num_entries : 0;
+				break;
+			case 1: /* ^A */
+			case LINEEDIT_KEY_HOME:
+				edit.position = 0;
+				break;
+			case 5: /* ^E */
+			case LINEEDIT_KEY_END:
+				edit.position = edit.length;
+				break;
+			case 2: /* ^B */
+			case LINEEDIT_KEY_LEFT:
+				if (edit.position > 0) {
+					edit.position--;
+				}
+				break;
+			case 6: /* ^F */
+			case LINEEDIT_KEY_RIGHT:
+				if (edit.position < edit.length) {
+					edit.position++;
+				}
+				break;
+			case 127: /* Backspace */
+			case 8:
+				if (edit.position > 0) {
+					lineedit_delete(&edit, edit.position - 1, edit.position);
+				}
+				break;
+			case LINEEDIT_KEY_DELETE:
+				if (edit.position < edit.length) {
+					lineedit_delete(&edit, edit.position, edit.position + 1);
+				}
+				break;
+			case 11: /* ^K */
+				lineedit_delete(&edit, edit.position, edit.length);
+				break;
+			case 21: /* ^U */
+				lineedit_delete(&edit, 0, edit.position);
+				break;
+			case '\t':
+				lineedit_complete(&edit);
+				break;
+			case 12: /* ^L */
+				lineedit_write("\x1b[H\x1b[2J", 7);
+				break;
+			case 16: /* ^P */
+			case LINEEDIT_KEY_UP:
+				lineedit_history(&edit, edit.entry - 1);
+				break;
+			case 14: /* ^N */
+			case LINEEDIT_KEY_DOWN:
+				lineedit_history(&edit, edit.entry + 1);
+				break;
+			default:
+				if (key >= 32 && key < 256) {
+					lineedit_insert(&edit, key);
+				}
+				break;
+		}
+	}
+	
+	edit.position = edit.length;
+	lineedit_draw(&edit, prompt);
+	lineedit_write("\r\n", 2);
+	
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &original);
+	free(edit.saved);
+	free(edit.screen);
+	
+	return more_to_read;
+}
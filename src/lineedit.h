@@ -0,0 +1,62 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define LINEEDIT_KEY_UP 256
+#define LINEEDIT_KEY_DOWN 257
+#define LINEEDIT_KEY_RIGHT 258
+#define LINEEDIT_KEY_LEFT 259
+#define LINEEDIT_KEY_HOME 260
+#define LINEEDIT_KEY_END 261
+#define LINEEDIT_KEY_DELETE 262
+
+#define LINEEDIT_INDEX_STEP 4096
+#define LINEEDIT_MAX_LIST 256
+
+#define LINEEDIT_SEARCH_PROMPT "(reverse-i-search)`%s': "
+#define LINEEDIT_FAILED_SEARCH_PROMPT "(failed reverse-i-search)`%s': "
+
+
+/***** Structures ***********************************************************/
+
+/* Line Editor Structure
+ *
+ * NOTE While browsing the history, entry is the index of the entry being
+ *      shown and saved holds the line that was being typed beforehand.
+ *      Otherwise entry is the number of entries in the history.
+ */
+struct history_s;
+typedef struct lineedit_s {
+	const char *prompt;
+	char *buffer;
+	int buffer_size;
+	int length;
+	int position;
+	struct history_s *history;
+	int entry;
+	char *saved;
+	char *screen;
+	} lineedit_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Line Editor Functions */
+int lineedit_read(struct history_s *history, const char *prompt,
+		char *buffer, int buffer_size);
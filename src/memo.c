@@ -0,0 +1,621 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "expression.h"
+#include "hash.h"
+#include "interpreter.h"
+#include "memo.h"
+#include "pathhash.h"
+#include "supervisor.h"
+#include "tmnsh.h"
+
+
+/***** Memo Buffer Functions ************************************************/
+
+/**
+ * int memo_buffer_add(memo_buffer_t *buffer, const void *data,
+ *                     unsigned long size)
+ *
+ * Appends the given data to the buffer. Once the buffer would grow past
+ * MEMO_MAX_OUTPUT bytes it is marked as overflowed and nothing more is
+ * added to it.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+static int memo_buffer_add(memo_buffer_t *buffer, const void *data,
+		unsigned long size) {
+	unsigned long max_size;
+	char *grown;
+	
+	if (buffer->overflowed || buffer->size + size > MEMO_MAX_OUTPUT) {
+		buffer->overflowed = TRUE;
+		return -1;
+	}
+	
+	if (buffer->size + size > buffer->max_size) {
+		max_size = (buffer->max_size == 0) ? 4096 : buffer->max_size * 2;
+		
+		while (max_size < buffer->size + size) {
+			max_size *= 2;
+		}
+		
+		grown = realloc(buffer->data, max_size);
+		
+		if (grown == NULL) {
+			buffer->overflowed = TRUE;
+			return -1;
+		}
+		
+		buffer->data = grown;
+		buffer->max_size = max_size;
+	}
+	
+	memcpy(buffer->data + buffer->size, data, size);
+	buffer->size += size;
+	
+	return 0;
+}
+
+/**
+ * void memo_buffer_free(memo_buffer_t *buffer)
+ *
+ * Frees the data held by the given buffer, leaving it empty.
+ */
+static void memo_buffer_free(memo_buffer_t *buffer) {
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->size = 0;
+	buffer->max_size = 0;
+	buffer->overflowed = FALSE;
+}
+
+/**
+ * int memo_write(int fd, const char *data, unsigned long size)
+ *
+ * Writes all of the given data to the given descriptor.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+static int memo_write(int fd, const char *data, unsigned long size) {
+	long written;
+	
+	while (size > 0) {
+		written = write(fd, data, size);
+		
+		if (written == -1 && errno == EINTR) {
+			continue;
+		} else if (written <= 0) {
+			return -1;
+		}
+		
+		data += written;
+		size -= written;
+	}
+	
+	return 0;
+}
+
+
+/***** Memo Key Functions ***************************************************/
+
+/**
+ * void memo_fingerprint(memo_buffer_t *key, const char *path,
+ *                       long *newest)
+ *
+ * Adds the given file's path, device, inode, size and modification time
+ * to the key, or a marker if it does not exist, and raises *newest to
+ * the file's modification time if that is later.
+ */
+static void memo_fingerprint(memo_buffer_t *key, const char *path,
+		long *newest) {
+	long fingerprint[5];
+	struct stat st;
+	
+	memo_buffer_add(key, path, strlen(path) + 1);
+	memset(fingerprint, 0, sizeof(fingerprint));
+	
+	if (stat(path, &st) == 0) {
+		fingerprint[0] = st.st_dev;
+		fingerprint[1] = st.st_ino;
+		fingerprint[2] = st.st_size;
+		fingerprint[3] = st.st_mtim.tv_sec;
+		fingerprint[4] = st.st_mtim.tv_nsec;
+		
+		if (st.st_mtim.tv_sec > *newest) {
+			*newest = st.st_mtim.tv_sec;
+		}
+	} else {
+		fingerprint[0] = -1; /* Missing. */
+	}
+	
+	memo_buffer_add(key, fingerprint, sizeof(fingerprint));
+}
+
+/**
+ * int memo_key(command_t *cmd, command_t *inner, memo_buffer_t *key,
+ *              long *newest)
+ *
+ * Parses a "memo [--dep file]... [--env name]... command [args...]"
+ * command, placing the command to run in inner, and builds the key its
+ * result is stored under: the whole command line, the working
+ * directory, the named environment variables and the fingerprints (see
+ * memo_fingerprint()) of the command's executable and every --dep file.
+ * *newest is set to the latest modification time among those files.
+ *
+ * NOTE The command's standard input is not part of the key, so only
+ *      commands which read their input from declared files should be
+ *      memoised.
+ *
+ * Returns 0 if successful, 1 if there can be no key because the working
+ * directory cannot be read, -1 if the command is malformed.
+ */
+static int memo_key(command_t *cmd, command_t *inner, memo_buffer_t *key,
+		long *newest) {
+	char cwd[CWD_MAX_SIZE];
+	const char *path;
+	const char *value;
+	int start;
+	int i;
+	
+	*newest = 0;
+	
+	for (start = 1; start < cmd->num_args; start += 2) {
+		if (strcmp(cmd->argv[start], "--") == 0) {
+			start++;
+			break;
+		} else if (strcmp(cmd->argv[start], "--dep") != 0 &&
+				strcmp(cmd->argv[start], "--env") != 0) {
+			break;
+		} else if (start + 1 >= cmd->num_args) {
+			return -1;
+		}
+	}
+	
+	if (start >= cmd->num_args) {
+		return -1;
+	}
+	
+	inner->num_args = cmd->num_args - start;
+	inner->max_args = COMMAND_MAX_ARGV;
+	
+	for (i = start; i < cmd->num_args; i++) {
+		inner->argv[i - start] = cmd->argv[i];
+	}
+	
+	inner->argv[inner->num_args] = NULL;
+	
+	for (i = 0; i < cmd->num_args; i++) {
+		memo_buffer_add(key, cmd->argv[i], strlen(cmd->argv[i]) + 1);
+	}
+	
+	if (getcwd(cwd, CWD_MAX_SIZE) == NULL) {
+		return 1; /* Any key would be shared with other directories. */
+	}
+	
+	memo_buffer_add(key, cwd, strlen(cwd) + 1);
+	
+	for (i = 1; i < start - 1; i += 2) {
+		if (strcmp(cmd->argv[i], "--env") == 0) {
+			value = getenv(cmd->argv[i+1]);
+			memo_buffer_add(key, (value != NULL) ? "=" : "!", 1);
+			memo_buffer_add(key, (value != NULL) ? value : "",
+					(value != NULL) ? strlen(value) + 1 : 1);
+		} else {
+			memo_fingerprint(key, cmd->argv[i+1], newest);
+		}
+	}
+	
+	path = pathhash_lookup(inner->argv[0]);
+	memo_fingerprint(key, (path != NULL) ? path : inner->argv[0], newest);
+	
+	return 0;
+}
+
+
+/***** Memo Cache Functions *************************************************/
+
+/**
+ * int memo_path(memo_buffer_t *key, char *path)
+ *
+ * Works out where the result stored under the given key lives, placing
+ * it in path (which must hold MEMO_PATH_MAX_SIZE bytes): a file named
+ * after the key's hash in the directory named by MEMO_DIR_VARIABLE, or
+ * else in tmnsh/memo under $XDG_CACHE_HOME or ~/.cache. The directories
+ * below $XDG_CACHE_HOME or $HOME (or the named directory itself) are
+ * created if need be, and the directory is not used if it belongs to
+ * another user.
+ *
+ * Returns 0 if successful, -1 (after printing an error message if a
+ * directory could not be created) if unsuccessful.
+ */
+static int memo_path(memo_buffer_t *key, char *path) {
+	const char *dir = getenv(MEMO_DIR_VARIABLE);
+	const char *base = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	unsigned long hash = hash_data(key->data, key->size, 0);
+	struct stat st;
+	char *slash;
+	size_t existing;
+	int length;
+	int result;
+	
+	if (dir != NULL && *dir == '/') {
+		length = snprintf(path, MEMO_PATH_MAX_SIZE, "%s/%016lx%s", dir, hash,
+				MEMO_SUFFIX);
+		existing = strrchr(dir, '/') - dir;
+	} else if (base != NULL && *base == '/') {
+		length = snprintf(path, MEMO_PATH_MAX_SIZE, "%s/%s/%016lx%s", base,
+				MEMO_DIR_NAME, hash, MEMO_SUFFIX);
+		existing = strlen(base);
+	} else if (home != NULL && *home == '/') {
+		length = snprintf(path, MEMO_PATH_MAX_SIZE, "%s/.cache/%s/%016lx%s",
+				home, MEMO_DIR_NAME, hash, MEMO_SUFFIX);
+		existing = strlen(home);
+	} else {
+		return -1;
+	}
+	
+	if (length < 0 || length >= MEMO_PATH_MAX_SIZE) {
+		return -1;
+	}
+	
+	/* Create each directory below the existing part, if need be. */
+	for (slash = strchr(path + existing + 1, '/'); slash != NULL;
+			slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		
+		if (mkdir(path, 0700) == -1 && errno != EEXIST) {
+			printf("!tmnsh: memo - %s - %s (%d)\n", path, strerror(errno),
+					errno);
+			*slash = '/';
+			return -1;
+		}
+		
+		*slash = '/';
+	}
+	
+	slash = strrchr(path, '/');
+	*slash = '\0';
+	result = stat(path, &st);
+	*slash = '/';
+	
+	if (result == -1 || st.st_uid != geteuid()) {
+		return -1;
+	}
+	
+	return 0;
+}
+
+/**
+ * int memo_replay(const char *path, memo_buffer_t *key, int out_fd,
+ *                 int *status)
+ *
+ * Looks for a result stored under the given key and, if there is one,
+ * writes its standard output to out_fd and its standard error to the
+ * standard error, and places its exit status in *status.
+ *
+ * NOTE The output and error are replayed one after the other, so any
+ *      interleaving between the two is not reproduced.
+ * NOTE A file which belongs to another user, or which anyone else could
+ *      have written to, is never replayed, as its contents would be
+ *      taken as the command's own output and status.
+ *
+ * Returns 0 if a result was replayed, -1 if there is none.
+ */
+static int memo_replay(const char *path, memo_buffer_t *key, int out_fd,
+		int *status) {
+	memo_header_t *header;
+	struct stat st;
+	char *data;
+	char *output;
+	int result = -1;
+	int fd;
+	
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	
+	if (fd == -1) {
+		return -1;
+	}
+	
+	if (fstat(fd, &st) == -1 || st.st_size < sizeof(memo_header_t) ||
+			st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+		close(fd);
+		return -1;
+	}
+	
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if (data == MAP_FAILED) {
+		return -1;
+	}
+	
+	header = (memo_header_t *) data;
+	
+	if (memcmp(header->magic, MEMO_MAGIC, sizeof(header->magic)) == 0 &&
+			header->version == MEMO_VERSION &&
+			header->key_size == key->size &&
+			sizeof(memo_header_t) + header->key_size + header->out_size +
+			header->err_size == st.st_size &&
+			memcmp(data + sizeof(memo_header_t), key->data, key->size) == 0) {
+		output = data + sizeof(memo_header_t) + header->key_size;
+		memo_write(out_fd, output, header->out_size);
+		memo_write(STDERR_FILENO, output + header->out_size, header->err_size);
+		
+		*status = header->status;
+		result = 0;
+	}
+	
+	munmap(data, st.st_size);
+	
+	return result;
+}
+
+/**
+ * void memo_store(const char *path, memo_buffer_t *key,
+ *                 memo_buffer_t *out, memo_buffer_t *err, int status)
+ *
+ * Stores a command's result under the given key. The file is written
+ * under a temporary name and renamed into place, so a concurrent
+ * replay never sees half of it.
+ */
+static void memo_store(const char *path, memo_buffer_t *key,
+		memo_buffer_t *out, memo_buffer_t *err, int status) {
+	char temp_path[MEMO_PATH_MAX_SIZE];
+	memo_header_t header;
+	int length;
+	int fd;
+	
+	length = snprintf(temp_path, MEMO_PATH_MAX_SIZE, "%s.%d", path,
+			(int) getpid());
+	
+	if (length < 0 || length >= MEMO_PATH_MAX_SIZE) {
+		return;
+	}
+	
+	fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	
+	if (fd == -1) {
+		return;
+	}
+	
+	memset(&header, 0, sizeof(memo_header_t));
+	memcpy(header.magic, MEMO_MAGIC, sizeof(header.magic));
+	header.version = MEMO_VERSION;
+	header.status = status;
+	header.key_size = key->size;
+	header.out_size = out->size;
+	header.err_size = err->size;
+	
+	if (memo_write(fd, (char *) &header, sizeof(memo_header_t)) == -1 ||
+			memo_write(fd, key->data, key->size) == -1 ||
+			memo_write(fd, out->data, out->size) == -1 ||
+			memo_write(fd, err->data, err->size) == -1 ||
+			close(fd) == -1 || rename(temp_path, path) == -1) {
+		unlink(temp_path);
+	}
+}
+
+
+/***** Memo Functions *******************************************************/
+
+/**
+ * int memo_command(command_t *cmd)
+ *
+ * Returns TRUE if the given command is a memo command, FALSE otherwise.
+ */
+int memo_command(command_t *cmd) {
+	return (strcmp(cmd->argv[0], "memo") == 0);
+}
+
+/**
+ * int memo_copy(void *data)
+ *
+ * Copies whatever a command has written to its output pipes (given by
+ * the memo_capture_t data) on to the real output and error, keeping a
+ * copy of each. Waits at most capture->poll_timeout milliseconds (or
+ * indefinitely, if that is -1) for something to arrive.
+ *
+ * Returns TRUE while either pipe is still open, FALSE once both are
+ * closed.
+ */
+static int memo_copy(void *data) {
+	memo_capture_t *capture = data;
+	char block[MEMO_BLOCK_SIZE];
+	struct pollfd fds[2];
+	long size;
+	int i;
+	
+	if (capture->fds[0] == -1 && capture->fds[1] == -1) {
+		return FALSE;
+	}
+	
+	for (i = 0; i < 2; i++) {
+		fds[i].fd = capture->fds[i];
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+	
+	if (poll(fds, 2, capture->poll_timeout) == -1) {
+		return (errno == EINTR);
+	}
+	
+	for (i = 0; i < 2; i++) {
+		if (fds[i].fd == -1 || fds[i].revents == 0) {
+			continue;
+		}
+		
+		size = read(fds[i].fd, block, MEMO_BLOCK_SIZE);
+		
+		if (size == -1 && errno == EINTR) {
+			continue;
+		} else if (size <= 0) {
+			close(capture->fds[i]);
+			capture->fds[i] = -1;
+			continue;
+		}
+		
+		memo_write((i == 0) ? capture->out_fd : STDERR_FILENO, block, size);
+		memo_buffer_add((i == 0) ? capture->out : capture->err, block, size);
+	}
+	
+	return (capture->fds[0] != -1 || capture->fds[1] != -1);
+}
+
+/**
+ * int memo_capture(command_t *cmd, int in_fd, int out_fd,
+ *                  memo_buffer_t *out, memo_buffer_t *err)
+ *
+ * Runs the given command (through interpret_command()) with its output
+ * and error going to pipes, copying both on to out_fd and the standard
+ * error as they arrive and keeping a copy in out and err.
+ *
+ * NOTE While supervised, the pipes are copied from the supervisor's
+ *      idle hook, so job timeouts still fire while the command runs.
+ *
+ * Returns the command's exit status.
+ */
+static int memo_capture(command_t *cmd, int in_fd, int out_fd,
+		memo_buffer_t *out, memo_buffer_t *err) {
+	memo_capture_t capture;
+	int out_pipe[2];
+	int err_pipe[2];
+	int status = 0;
+	pid_t pid;
+	
+	if (pipe2(out_pipe, O_CLOEXEC) == -1) {
+		printf("!tmnsh: pipe - %s (%d)\n", strerror(errno), errno);
+		return 1;
+	}
+	
+	if (pipe2(err_pipe, O_CLOEXEC) == -1) {
+		printf("!tmnsh: pipe - %s (%d)\n", strerror(errno), errno);
+		close(out_pipe[0]);
+		close(out_pipe[1]);
+		return 1;
+	}
+	
+	pid = interpret_command(cmd, in_fd, out_pipe[1], err_pipe[1], FALSE);
+	close(out_pipe[1]);
+	close(err_pipe[1]);
+	
+	capture.fds[0] = out_pipe[0];
+	capture.fds[1] = err_pipe[0];
+	capture.out_fd = out_fd;
+	capture.out = out;
+	capture.err = err;
+	
+	if (supervisor_active()) {
+		capture.poll_timeout = MEMO_POLL_INTERVAL;
+		status = supervisor_wait(pid, memo_copy, &capture);
+	}
+	
+	/* Copy whatever is left (or everything, if not supervised). */
+	capture.poll_timeout = -1;
+	
+	while (memo_copy(&capture) == TRUE) {
+	}
+	
+	if (!supervisor_active()) {
+		status = interpret_wait(pid);
+	}
+	
+	return status;
+}
+
+/**
+ * int memo_run(command_t *cmd, int in_fd, int out_fd)
+ *
+ * Runs a "memo [--dep file]... [--env name]... command [args...]"
+ * command. If a result is stored under the command's key (see
+ * memo_key()) it is replayed without running anything. Otherwise the
+ * command is run with in_fd and out_fd as its standard input and output
+ * and, if it succeeds, its output, error and status are stored for next
+ * time.
+ *
+ * NOTE If the working directory cannot be read the command is just run,
+ *      as its result could not be told apart from other directories'.
+ * NOTE A result is not stored if the key changed while the command ran
+ *      (i.e. a dependency was modified), or if any file in the key was
+ *      modified in the second the command started, since it could then
+ *      change again without its modification time changing.
+ *
+ * Returns the command's exit status, replayed or not.
+ */
+int memo_run(command_t *cmd, int in_fd, int out_fd) {
+	char path[MEMO_PATH_MAX_SIZE];
+	memo_buffer_t key = {NULL, 0, 0, FALSE};
+	memo_buffer_t check = {NULL, 0, 0, FALSE};
+	memo_buffer_t out = {NULL, 0, 0, FALSE};
+	memo_buffer_t err = {NULL, 0, 0, FALSE};
+	command_t inner;
+	long newest;
+	long started;
+	int status;
+	int result;
+	
+	fflush(stdout); /* Keep replayed output in order. */
+	
+	if ((result = memo_key(cmd, &inner, &key, &newest)) == -1 ||
+			key.overflowed) {
+		printf("!tmnsh: memo - usage: memo [--dep file]... [--env name]... "
+				"command [args...]\n");
+		fflush(stdout);
+		memo_buffer_free(&key);
+		return MEMO_USAGE_STATUS;
+	}
+	
+	if (result == 1 || memo_path(&key, path) == -1) {
+		path[0] = '\0'; /* Just run the command. */
+	} else if (memo_replay(path, &key, out_fd, &status) == 0) {
+		memo_buffer_free(&key);
+		return status;
+	}
+	
+	started = time(NULL);
+	status = memo_capture(&inner, in_fd, out_fd, &out, &err);
+	
+	if (status == 0 && path[0] != '\0' && newest < started &&
+			!out.overflowed && !err.overflowed &&
+			memo_key(cmd, &inner, &check, &newest) == 0 &&
+			check.size == key.size &&
+			memcmp(check.data, key.data, key.size) == 0) {
+		memo_store(path, &key, &out, &err, status);
+	}
+	
+	memo_buffer_free(&key);
+	memo_buffer_free(&check);
+	memo_buffer_free(&out);
+	memo_buffer_free(&err);
+	
+	return status;
+}
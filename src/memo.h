@@ -0,0 +1,74 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define MEMO_MAGIC "TMNM"
+#define MEMO_VERSION 1
+#define MEMO_SUFFIX ".memo"
+#define MEMO_DIR_VARIABLE "TMNSH_MEMO_DIR"
+#define MEMO_DIR_NAME "tmnsh/memo"
+#define MEMO_PATH_MAX_SIZE 4097
+#define MEMO_BLOCK_SIZE 65536
+#define MEMO_MAX_OUTPUT 67108864
+#define MEMO_POLL_INTERVAL 50
+#define MEMO_USAGE_STATUS 2
+
+
+/***** Structures ***********************************************************/
+
+/* Memo File Header Structure
+ *
+ * NOTE A memo file holds the header, the key it was stored under and
+ *      the command's standard output and error, in that order. The key
+ *      is compared in full, so a hash collision can never replay the
+ *      wrong output. Memo files are written in the host's native byte
+ *      order.
+ */
+typedef struct memo_header_s {
+	char magic[4];
+	unsigned int version;
+	int status;
+	unsigned long key_size;
+	unsigned long out_size;
+	unsigned long err_size;
+	} memo_header_t;
+
+/* Memo Buffer Structure - Grows up to MEMO_MAX_OUTPUT bytes. */
+typedef struct memo_buffer_s {
+	char *data;
+	unsigned long size;
+	unsigned long max_size;
+	int overflowed;
+	} memo_buffer_t;
+
+/* Memo Capture Structure - A command's output pipes, being copied. */
+typedef struct memo_capture_s {
+	int fds[2];
+	int out_fd;
+	int poll_timeout;
+	memo_buffer_t *out;
+	memo_buffer_t *err;
+	} memo_capture_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Memo Functions */
+int memo_command(command_t *cmd);
+int memo_run(command_t *cmd, int in_fd, int out_fd);
@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "expression.h"
 #include "parser.h"
@@ -146,7 +147,8 @@ tokarray_t *tokenise_input(char *buffer) {
  * expression_t *parse_tokens(tokarray_t *tokens)
  *
  * Parses the given tokens into commands, placing each command into a
- * single expression structure.
+ * single expression structure. Any syntax error is printed straight
+ * away (see parse_tokens_error()).
  *
  * NOTE Commands are separated by the pipe character ('|').
  *
@@ -155,13 +157,38 @@ tokarray_t *tokenise_input(char *buffer) {
  * needed.
  */
 expression_t *parse_tokens(tokarray_t *tokens) {
+	char error[PARSER_ERROR_MAX_SIZE];
+	expression_t *expr = parse_tokens_error(tokens, error);
+	
+	if (error[0] != '\0') {
+		printf("%s", error);
+	}
+	
+	return expr;
+}
+
+/**
+ * expression_t *parse_tokens_error(tokarray_t *tokens, char *error)
+ *
+ * Parses the given tokens as parse_tokens() does, but places any syntax
+ * error message in error (which must hold PARSER_ERROR_MAX_SIZE bytes)
+ * rather than printing it, so that it can be reported later. The error
+ * is left empty if there is none.
+ *
+ * Returns a pointer to a new expression structure, or NULL if the
+ * tokens could not be parsed.
+ */
+expression_t *parse_tokens_error(tokarray_t *tokens, char *error) {
 	expression_t *expr = expression_create();
 	command_t *cmd = command_create();
 	int index = 0;
 	int syntax_error = FALSE;
 	
+	error[0] = '\0';
+	
 	if (tokens->num_tokens == 0) {
-		printf("!tmnsh: Cannot parse a tokarray with 0 tokens.\n");
+		snprintf(error, PARSER_ERROR_MAX_SIZE,
+				"!tmnsh: Cannot parse a tokarray with 0 tokens.\n");
 		expression_destroy(expr);
 		command_destroy(cmd);
 		return NULL;
@@ -187,7 +214,9 @@ expression_t *parse_tokens(tokarray_t *tokens) {
 	
 	/* Handle syntax errors. */
 	if (syntax_error) {
-		printf("!tmnsh: Syntax error at token %d: %s\n", index, tokens->tokens[index]);
+		snprintf(error, PARSER_ERROR_MAX_SIZE,
+				"!tmnsh: Syntax error at token %d: %s\n", index,
+				tokens->tokens[index]);
 		/* Clean up. */
 		expression_destroy(expr);
 		command_destroy(cmd);
@@ -202,7 +231,9 @@ expression_t *parse_tokens(tokarray_t *tokens) {
 	
 	/* Check to ensure the most recent command is valid. */
 	if (cmd->num_args < 1) {
-		printf("!tmnsh: Syntax error at token %d: %s\n", index-1, tokens->tokens[index-1]);
+		snprintf(error, PARSER_ERROR_MAX_SIZE,
+				"!tmnsh: Syntax error at token %d: %s\n", index-1,
+				tokens->tokens[index-1]);
 		/* Clean up. */
 		command_destroy(cmd);
 		return NULL;
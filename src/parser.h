@@ -19,6 +19,7 @@
 /***** Defines **************************************************************/
 
 #define TOKARRAY_MAX_TOKENS 513
+#define PARSER_ERROR_MAX_SIZE 256
 
 
 /***** Structures ***********************************************************/
@@ -42,3 +43,4 @@ tokarray_t *tokenise_input(char *buffer);
 
 /* Parser */
 expression_t *parse_tokens(tokarray_t *tokens);
+expression_t *parse_tokens_error(tokarray_t *tokens, char *error);
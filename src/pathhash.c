@@ -0,0 +1,315 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "pathhash.h"
+#include "tmnsh.h"
+
+
+/***** Globals **************************************************************/
+
+/* Path Hash - Maps command names to the executables they run. */
+static pathhash_entry_t *buckets[PATHHASH_NUM_BUCKETS];
+
+
+/***** Path Hash Functions **************************************************/
+
+/**
+ * pathhash_entry_t **pathhash_bucket(const char *name)
+ *
+ * Returns a pointer to the head of the bucket the given name hashes to.
+ */
+static pathhash_entry_t **pathhash_bucket(const char *name) {
+	return &buckets[hash_data(name, strlen(name), 0) %
+			PATHHASH_NUM_BUCKETS];
+}
+
+/**
+ * int pathhash_executable(const char *path)
+ *
+ * Returns TRUE if the given path is an executable regular file, FALSE
+ * otherwise.
+ */
+static int pathhash_executable(const char *path) {
+	struct stat st;
+	
+	return (stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+			access(path, X_OK) == 0);
+}
+
+/**
+ * int pathhash_relative_path()
+ *
+ * Returns TRUE if PATH holds a relative (or empty, meaning the current)
+ * directory, FALSE otherwise.
+ */
+static int pathhash_relative_path() {
+	const char *dirs = getenv("PATH");
+	
+	while (dirs != NULL) {
+		if (*dirs != '/') {
+			return TRUE;
+		}
+		
+		dirs = strchr(dirs, ':');
+		
+		if (dirs != NULL) {
+			dirs++;
+		}
+	}
+	
+	return FALSE;
+}
+
+/**
+ * const char *pathhash_lookup(const char *name)
+ *
+ * Finds the executable a command name refers to, searching the
+ * directories in PATH as execvp() would and remembering the result.
+ *
+ * NOTE If PATH holds a relative directory the path hash is not used at
+ *      all, since what that directory holds changes with the working
+ *      directory and a remembered result could run a different program
+ *      than execvp() would.
+ *
+ * Returns the path of the executable, or NULL if the name contains a
+ * slash, PATH holds a relative directory or the name cannot be found
+ * (in which case execvp() should be used). The path must not be freed.
+ */
+const char *pathhash_lookup(const char *name) {
+	pathhash_entry_t *entry;
+	
+	if (strchr(name, '/') != NULL || pathhash_relative_path()) {
+		return NULL;
+	}
+	
+	for (entry = *pathhash_bucket(name); entry != NULL; entry = entry->next) {
+		if (strcmp(entry->name, name) == 0) {
+			return entry->path;
+		}
+	}
+	
+	return pathhash_resolve(name);
+}
+
+/**
+ * const char *pathhash_resolve(const char *name)
+ *
+ * Searches the absolute PATH directories afresh for the given command
+ * name, ignoring anything remembered for it, and then remembers the
+ * executable found or forgets the name if there is none. This is how
+ * the path hash is kept up to date when PATH directories change.
+ *
+ * NOTE Relative PATH directories are skipped here, which is why
+ *      pathhash_lookup() does not use the path hash while PATH holds
+ *      one.
+ *
+ * Returns the path of the executable, or NULL if the name contains a
+ * slash or cannot be found. The path must not be freed.
+ */
+const char *pathhash_resolve(const char *name) {
+	char path[PATHHASH_PATH_MAX_SIZE];
+	const char *dirs = getenv("PATH");
+	const char *end;
+	int length;
+	
+	if (strchr(name, '/') != NULL) {
+		return NULL;
+	}
+	
+	while (dirs != NULL && *dirs != '\0') {
+		end = strchr(dirs, ':');
+		if (end == NULL) {
+			end = dirs + strlen(dirs);
+		}
+		
+		length = snprintf(path, PATHHASH_PATH_MAX_SIZE, "%.*s/%s",
+				(int) (end - dirs), dirs, name);
+		
+		if (*dirs == '/' && length < PATHHASH_PATH_MAX_SIZE &&
+				pathhash_executable(path)) {
+			pathhash_insert(name, path);
+			return (*pathhash_bucket(name))->path;
+		}
+		
+		dirs = (*end == ':') ? end + 1 : end;
+	}
+	
+	pathhash_remove(name);
+	
+	return NULL;
+}
+
+/**
+ * void pathhash_insert(const char *name, const char *path)
+ *
+ * Remembers that the given command name runs the executable at path,
+ * replacing anything remembered for that name before.
+ */
+void pathhash_insert(const char *name, const char *path) {
+	pathhash_entry_t **bucket = pathhash_bucket(name);
+	pathhash_entry_t *entry;
+	
+	pathhash_remove(name);
+	
+	entry = malloc(sizeof(pathhash_entry_t));
+	entry->name = malloc(strlen(name) + 1);
+	strcpy(entry->name, name);
+	entry->path = malloc(strlen(path) + 1);
+	strcpy(entry->path, path);
+	entry->next = *bucket;
+	*bucket = entry;
+}
+
+/**
+ * int pathhash_remove(const char *name)
+ *
+ * Forgets the executable remembered for the given command name.
+ *
+ * Returns 0 if successful, -1 if nothing was remembered for the name.
+ */
+int pathhash_remove(const char *name) {
+	pathhash_entry_t **link = pathhash_bucket(name);
+	pathhash_entry_t *entry;
+	
+	for (entry = *link; entry != NULL; link = &entry->next, entry = *link) {
+		if (strcmp(entry->name, name) == 0) {
+			*link = entry->next;
+			free(entry->name);
+			free(entry->path);
+			free(entry);
+			return 0;
+		}
+	}
+	
+	return -1;
+}
+
+/**
+ * void pathhash_clear()
+ *
+ * Forgets everything remembered in the path hash, i.e. once PATH has
+ * been replaced by a different one.
+ */
+void pathhash_clear() {
+	pathhash_entry_t *entry;
+	int index;
+	
+	for (index = 0; index < PATHHASH_NUM_BUCKETS; index++) {
+		while ((entry = buckets[index]) != NULL) {
+			buckets[index] = entry->next;
+			free(entry->name);
+			free(entry->path);
+			free(entry);
+		}
+	}
+}
+
+/**
+ * int pathhash_scan(void (*found)(const char *name, void *data),
+ *                   void *data)
+ *
+ * Fills the path hash with every executable in every absolute PATH
+ * directory up front, so that later lookups (including those made by
+ * processes forked afterwards) never have to search PATH. Where a name
+ * appears in more than one directory the first one wins, as in
+ * execvp(); pathhash_lookup() ignores the result while PATH holds a
+ * relative directory. If found is not NULL it is called with data for
+ * the name of every executable (some more than once), i.e. to build the
+ * command trie from the same scan.
+ *
+ * Returns the number of executables found.
+ */
+int pathhash_scan(void (*found)(const char *name, void *data),
+		void *data) {
+	char path[PATHHASH_PATH_MAX_SIZE];
+	char dir[PATHHASH_PATH_MAX_SIZE];
+	const char *dirs = getenv("PATH");
+	const char *end;
+	struct dirent *file;
+	pathhash_entry_t *entry;
+	DIR *stream;
+	int num_found = 0;
+	int length;
+	
+	while (dirs != NULL && *dirs != '\0') {
+		end = strchr(dirs, ':');
+		if (end == NULL) {
+			end = dirs + strlen(dirs);
+		}
+		
+		length = end - dirs;
+		stream = NULL;
+		
+		if (*dirs == '/' && length < PATHHASH_PATH_MAX_SIZE) {
+			strncpy(dir, dirs, length);
+			dir[length] = '\0';
+			stream = opendir(dir);
+		}
+		
+		if (stream != NULL) {
+			while ((file = readdir(stream)) != NULL) {
+				for (entry = *pathhash_bucket(file->d_name); entry != NULL;
+						entry = entry->next) {
+					if (strcmp(entry->name, file->d_name) == 0) {
+						break;
+					}
+				}
+				
+				if (file->d_name[0] == '.') {
+					continue;
+				} else if (entry != NULL) {
+					if (found != NULL) {
+						found(file->d_name, data);
+					}
+					
+					continue;
+				}
+				
+				length = snprintf(path, PATHHASH_PATH_MAX_SIZE, "%s/%s", dir,
+						file->d_name);
+				
+				if (length < PATHHASH_PATH_MAX_SIZE &&
+						pathhash_executable(path)) {
+					pathhash_insert(file->d_name, path);
+					num_found++;
+					
+					if (found != NULL) {
+						found(file->d_name, data);
+					}
+				}
+			}
+			
+			closedir(stream);
+		}
+		
+		dirs = (*end == ':') ? end + 1 : end;
+	}
+	
+	return num_found;
+}
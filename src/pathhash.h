@@ -0,0 +1,44 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define PATHHASH_NUM_BUCKETS 16384
+#define PATHHASH_PATH_MAX_SIZE 4097
+
+
+/***** Structures ***********************************************************/
+
+/* Path Hash Entry Structure */
+typedef struct pathhash_entry_s {
+	char *name;
+	char *path;
+	struct pathhash_entry_s *next;
+	} pathhash_entry_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Path Hash Functions */
+const char *pathhash_lookup(const char *name);
+const char *pathhash_resolve(const char *name);
+void pathhash_insert(const char *name, const char *path);
+int pathhash_remove(const char *name);
+void pathhash_clear();
+int pathhash_scan(void (*found)(const char *name, void *data),
+		void *data);
@@ -0,0 +1,827 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "expression.h"
+#include "placement.h"
+#include "tmnsh.h"
+
+
+/***** Globals **************************************************************/
+
+/* Background Placement - Applied to every background job. */
+static placement_t background_placement;
+
+/* Cgroup Root - Found once, by the shell, on first use. */
+static char cgroup_root[PLACEMENT_PATH_MAX_SIZE] = "";
+
+
+/***** Cgroup Functions *****************************************************/
+
+/**
+ * int placement_current(char *dir)
+ *
+ * Finds the directory of the cgroup v2 group the calling process is in,
+ * through /proc/self/mounts and /proc/self/cgroup, and copies it to dir
+ * (which must hold PLACEMENT_PATH_MAX_SIZE characters).
+ *
+ * Returns 0 if successful, -1 if there is no cgroup v2 hierarchy.
+ */
+static int placement_current(char *dir) {
+	char line[PLACEMENT_PATH_MAX_SIZE];
+	char mount[PLACEMENT_PATH_MAX_SIZE] = "";
+	char group[PLACEMENT_PATH_MAX_SIZE] = "";
+	FILE *file;
+	
+	if ((file = fopen("/proc/self/mounts", "r")) != NULL) {
+		while (fgets(line, PLACEMENT_PATH_MAX_SIZE, file) != NULL) {
+			if (sscanf(line, "%*s %4096s cgroup2 ", mount) == 1 &&
+					strstr(line, " cgroup2 ") != NULL) {
+				break;
+			}
+			
+			mount[0] = '\0';
+		}
+		
+		fclose(file);
+	}
+	
+	if ((file = fopen("/proc/self/cgroup", "r")) != NULL) {
+		while (fgets(line, PLACEMENT_PATH_MAX_SIZE, file) != NULL) {
+			if (strncmp(line, "0::", 3) == 0) {
+				line[strcspn(line, "\n")] = '\0';
+				snprintf(group, PLACEMENT_PATH_MAX_SIZE, "%s", &line[3]);
+				break;
+			}
+		}
+		
+		fclose(file);
+	}
+	
+	if (mount[0] == '\0' || group[0] != '/') {
+		return -1;
+	}
+	
+	if (strcmp(group, "/") == 0) {
+		group[0] = '\0';
+	}
+	
+	snprintf(dir, PLACEMENT_PATH_MAX_SIZE, "%s%s", mount, group);
+	
+	return 0;
+}
+
+/**
+ * const char *placement_root()
+ *
+ * Finds the directory under which cgroups named by cgexec and the cgroup
+ * builtin live: TMNSH_CGROUP_ROOT if it is set, otherwise the cgroup v2
+ * group the shell was started in (found through /proc/self/mounts and
+ * /proc/self/cgroup).
+ *
+ * NOTE The root is remembered the first time it is found, so it does not
+ *      move if the shell later moves itself (see placement_evacuate()).
+ *
+ * Returns the root directory, or NULL (after printing an error message)
+ * if there is no cgroup v2 hierarchy.
+ */
+static const char *placement_root() {
+	const char *variable = getenv(PLACEMENT_ROOT_VARIABLE);
+	
+	if (cgroup_root[0] != '\0') {
+		return cgroup_root;
+	}
+	
+	if (variable != NULL && variable[0] != '\0') {
+		snprintf(cgroup_root, PLACEMENT_PATH_MAX_SIZE, "%s", variable);
+		return cgroup_root;
+	}
+	
+	if (placement_current(cgroup_root) == -1) {
+		cgroup_root[0] = '\0';
+		printf("!tmnsh: cgroup - no cgroup v2 hierarchy (set %s)\n",
+				PLACEMENT_ROOT_VARIABLE);
+		return NULL;
+	}
+	
+	return cgroup_root;
+}
+
+/**
+ * int placement_write(const char *dir, const char *file,
+ *                     const char *value)
+ *
+ * Writes the given value to a cgroup interface file, i.e. "cpu.max", in
+ * the given cgroup directory.
+ *
+ * Returns 0 if successful, -1 (leaving errno set) if unsuccessful.
+ */
+static int placement_write(const char *dir, const char *file,
+		const char *value) {
+	char path[PLACEMENT_PATH_MAX_SIZE];
+	ssize_t result;
+	int fd;
+	
+	if (snprintf(path, PLACEMENT_PATH_MAX_SIZE, "%s/%s", dir, file) >=
+			PLACEMENT_PATH_MAX_SIZE) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	
+	if ((fd = open(path, O_WRONLY)) == -1) {
+		return -1;
+	}
+	
+	result = write(fd, value, strlen(value));
+	
+	if (close(fd) == -1 || result == -1) {
+		return -1;
+	}
+	
+	return 0;
+}
+
+/**
+ * int placement_join(const char *dir)
+ *
+ * Moves the calling process into the given cgroup directory by writing
+ * its process ID to the group's cgroup.procs file.
+ *
+ * Returns 0 if successful, -1 (leaving errno set) if unsuccessful.
+ */
+static int placement_join(const char *dir) {
+	char pid[32];
+	
+	sprintf(pid, "%d\n", (int)getpid());
+	
+	return placement_write(dir, "cgroup.procs", pid);
+}
+
+/**
+ * int placement_evacuate(const char *root)
+ *
+ * Moves the shell out of the cgroup root into a leaf group of its own,
+ * named PLACEMENT_SHELL_GROUP, so that controllers can be enabled for
+ * the root's children.
+ *
+ * NOTE cgroup v2 only hands controllers down from a group which has no
+ *      processes of its own ("no internal processes"), and a delegated
+ *      root is usually the group the shell was started in. Children the
+ *      shell has already started are left where they are.
+ *
+ * Returns 0 if successful, -1 (leaving errno set) if unsuccessful.
+ */
+static int placement_evacuate(const char *root) {
+	char dir[PLACEMENT_PATH_MAX_SIZE];
+	
+	snprintf(dir, PLACEMENT_PATH_MAX_SIZE, "%s/%s", root,
+			PLACEMENT_SHELL_GROUP);
+	
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+		return -1;
+	}
+	
+	return placement_join(dir);
+}
+
+/**
+ * int placement_enable(const char *root, const char *name,
+ *                      const char *controller)
+ *
+ * Enables the given controller, i.e. "memory", for the named cgroup by
+ * adding it to the cgroup.subtree_control file of the root and of each
+ * group between the root and the named one.
+ *
+ * Returns 0 if successful, -1 (after printing an error message naming
+ * the file which could not be written) if unsuccessful.
+ */
+static int placement_enable(const char *root, const char *name,
+		const char *controller) {
+	char dir[PLACEMENT_PATH_MAX_SIZE];
+	char value[64];
+	const char *slash = name;
+	
+	snprintf(value, sizeof(value), "+%s", controller);
+	snprintf(dir, PLACEMENT_PATH_MAX_SIZE, "%s", root);
+	
+	while (slash != NULL) {
+		if (placement_write(dir, "cgroup.subtree_control", value) == -1 &&
+				(errno != EBUSY || slash != name ||
+				placement_evacuate(root) == -1 ||
+				placement_write(dir, "cgroup.subtree_control", value) == -1)) {
+			printf("!tmnsh: cgroup - %s/cgroup.subtree_control - %s - %s "
+					"(%d)\n", dir, value, strerror(errno), errno);
+			return -1;
+		}
+		
+		if ((slash = strchr(slash, '/')) != NULL) {
+			snprintf(dir, PLACEMENT_PATH_MAX_SIZE, "%s/%.*s", root,
+					(int)(slash - name), name);
+			slash++;
+		}
+	}
+	
+	return 0;
+}
+
+
+/**
+ * void placement_remove(char *dir, size_t keep)
+ *
+ * Removes the given cgroup directory and then each of its parents, for
+ * as long as the path is longer than its first keep characters, i.e.
+ * the groups the cgroup builtin created before it failed. The path is
+ * cut short in place as it goes.
+ */
+static void placement_remove(char *dir, size_t keep) {
+	char *slash;
+	
+	while (strlen(dir) > keep && rmdir(dir) == 0 &&
+			(slash = strrchr(dir, '/')) != NULL) {
+		*slash = '\0';
+	}
+}
+
+
+/***** Option Parsing Functions *********************************************/
+
+/**
+ * int placement_setting(const char *word)
+ *
+ * Returns TRUE if the given word of the cgroup builtin starts a setting,
+ * i.e. "cpu.max=50000", being a cgroup interface file name (which always
+ * holds a dot) followed by an equals sign, FALSE otherwise.
+ */
+static int placement_setting(const char *word) {
+	size_t length = strcspn(word, "=");
+	
+	return (word[length] == '=' && length > 0 &&
+			memchr(word, '.', length) != NULL &&
+			memchr(word, '/', length) == NULL);
+}
+
+/**
+ * int placement_number(const char *text, int min, int max, int *value)
+ *
+ * Parses the whole of the given text as a decimal integer between min
+ * and max inclusive.
+ *
+ * Returns TRUE if successful, FALSE if unsuccessful.
+ */
+static int placement_number(const char *text, int min, int max,
+		int *value) {
+	char *end;
+	long number;
+	
+	if (text == NULL || text[0] == '\0') {
+		return FALSE;
+	}
+	
+	number = strtol(text, &end, 10);
+	
+	if (*end != '\0' || number < min || number > max) {
+		return FALSE;
+	}
+	
+	*value = (int)number;
+	
+	return TRUE;
+}
+
+/**
+ * int placement_cpus(const char *list, cpu_set_t *cpus)
+ *
+ * Parses a CPU list as taken by "taskset -c", i.e. "0-3,8,10-15:2".
+ *
+ * Returns TRUE if successful, FALSE if unsuccessful.
+ */
+static int placement_cpus(const char *list, cpu_set_t *cpus) {
+	long first, last, stride;
+	char *end;
+	
+	CPU_ZERO(cpus);
+	
+	if (list == NULL || list[0] == '\0') {
+		return FALSE;
+	}
+	
+	for (;;) {
+		if (*list < '0' || *list > '9') {
+			return FALSE;
+		}
+		
+		first = last = strtol(list, &end, 10);
+		stride = 1;
+		
+		if (*end == '-') {
+			last = strtol(&end[1], &end, 10);
+			
+			if (*end == ':') {
+				stride = strtol(&end[1], &end, 10);
+			}
+		}
+		
+		if (last < first || stride < 1 || last >= CPU_SETSIZE) {
+			return FALSE;
+		}
+		
+		for (; first <= last; first += stride) {
+			CPU_SET(first, cpus);
+		}
+		
+		if (*end == '\0') {
+			return TRUE;
+		} else if (*end != ',') {
+			return FALSE;
+		}
+		
+		list = &end[1];
+	}
+}
+
+/**
+ * int placement_ioprio_class(const char *text, int *class)
+ *
+ * Parses an I/O scheduling class as taken by "ionice -c": a number from
+ * 0 to 3 or one of the names none, realtime, best-effort and idle.
+ *
+ * Returns TRUE if successful, FALSE if unsuccessful.
+ */
+static int placement_ioprio_class(const char *text, int *class) {
+	static const char *names[] = {"none", "realtime", "best-effort", "idle"};
+	int i;
+	
+	for (i = 0; text != NULL && i < 4; i++) {
+		if (strcmp(text, names[i]) == 0) {
+			*class = i;
+			return TRUE;
+		}
+	}
+	
+	return placement_number(text, 0, 3, class);
+}
+
+/**
+ * int placement_parse_nice(char **argv, placement_t *placement)
+ *
+ * Parses "nice [-n adjustment | -adjustment]". Nested nice prefixes add
+ * up, as they would if the real command were run.
+ *
+ * Returns the number of words used.
+ */
+static int placement_parse_nice(char **argv, placement_t *placement) {
+	int adjustment = PLACEMENT_DEFAULT_NICE;
+	int used = 1;
+	
+	if (argv[1] != NULL && strcmp(argv[1], "-n") == 0) {
+		if (!placement_number(argv[2], -40, 40, &adjustment)) {
+			return 0;
+		}
+		
+		used = 3;
+	} else if (argv[1] != NULL && argv[1][0] == '-' &&
+			strcmp(argv[1], "--") != 0) {
+		if (!placement_number(&argv[1][1], -40, 40, &adjustment)) {
+			return 0;
+		}
+		
+		used = 2;
+	}
+	
+	placement->nice = (placement->has_nice ? placement->nice : 0) +
+			adjustment;
+	placement->has_nice = TRUE;
+	
+	return used;
+}
+
+/**
+ * int placement_parse_taskset(char **argv, placement_t *placement)
+ *
+ * Parses "taskset -c list" (or --cpu-list). The mask form of taskset is
+ * left to the real command.
+ *
+ * Returns the number of words used, or 0 if the words are not of that
+ * form.
+ */
+static int placement_parse_taskset(char **argv, placement_t *placement) {
+	if (argv[1] == NULL || (strcmp(argv[1], "-c") != 0 &&
+			strcmp(argv[1], "--cpu-list") != 0) ||
+			!placement_cpus(argv[2], &placement->cpus)) {
+		return 0;
+	}
+	
+	placement->has_cpus = TRUE;
+	
+	return 3;
+}
+
+/**
+ * int placement_parse_ionice(char **argv, placement_t *placement)
+ *
+ * Parses "ionice -c class [-n level]", in either order.
+ *
+ * Returns the number of words used, or 0 if the words are not of that
+ * form.
+ */
+static int placement_parse_ionice(char **argv, placement_t *placement) {
+	int level = PLACEMENT_DEFAULT_IOPRIO_LEVEL;
+	int class = -1;
+	int used = 1;
+	
+	while (argv[used] != NULL && argv[used + 1] != NULL) {
+		if (strcmp(argv[used], "-c") == 0) {
+			if (!placement_ioprio_class(argv[used + 1], &class)) {
+				return 0;
+			}
+		} else if (strcmp(argv[used], "-n") == 0) {
+			if (!placement_number(argv[used + 1], 0, 7, &level)) {
+				return 0;
+			}
+		} else {
+			break;
+		}
+		
+		used += 2;
+	}
+	
+	if (class == -1) {
+		return 0;
+	}
+	
+	if (class == 0 || class == 3) {
+		level = 0; /* The kernel ignores the level for these classes. */
+	}
+	
+	placement->ioprio = (class << PLACEMENT_IOPRIO_CLASS_SHIFT) | level;
+	placement->has_ioprio = TRUE;
+	
+	return used;
+}
+
+/**
+ * int placement_parse_cgexec(char **argv, placement_t *placement)
+ *
+ * Parses "cgexec -g controllers:path". With cgroup v2 there is only one
+ * hierarchy, so the controllers are ignored and the path is taken as a
+ * group below the cgroup root.
+ *
+ * Returns the number of words used, or 0 if the words are not of that
+ * form.
+ */
+static int placement_parse_cgexec(char **argv, placement_t *placement) {
+	const char *path;
+	const char *root;
+	
+	if (argv[1] == NULL || strcmp(argv[1], "-g") != 0 || argv[2] == NULL ||
+			(path = strchr(argv[2], ':')) == NULL) {
+		return 0;
+	}
+	
+	if ((root = placement_root()) == NULL) {
+		return 0;
+	}
+	
+	for (path++; *path == '/'; path++);
+	
+	if (snprintf(placement->cgroup, PLACEMENT_PATH_MAX_SIZE, "%s/%s", root,
+			path) >= PLACEMENT_PATH_MAX_SIZE) {
+		placement->cgroup[0] = '\0';
+		return 0;
+	}
+	
+	return 3;
+}
+
+
+/***** Placement Functions **************************************************/
+
+/**
+ * void placement_init(placement_t *placement)
+ *
+ * Clears the given placement, so that it changes nothing.
+ */
+void placement_init(placement_t *placement) {
+	memset(placement, 0, sizeof(placement_t));
+}
+
+/**
+ * int placement_parse(char **argv, placement_t *placement)
+ *
+ * Checks whether the given command starts with one of the wrapper
+ * commands "nice", "taskset -c", "ionice" or "cgexec -g" and, if so,
+ * adds its settings to the placement.
+ *
+ * NOTE The words are parsed as the real commands would take them; any
+ *      form not understood here is left to the real command. A "--"
+ *      ending the wrapper's options is used too, while any other option
+ *      after those understood here (i.e. "ionice -c 3 -p 42") leaves the
+ *      whole command to the real one. Whether a command follows the
+ *      wrapper is up to the caller.
+ *
+ * Returns the number of words used, or 0 if the command does not start
+ * with a wrapper understood here.
+ */
+int placement_parse(char **argv, placement_t *placement) {
+	int used = 0;
+	
+	if (argv[0] == NULL) {
+		return 0;
+	} else if (strcmp(argv[0], "nice") == 0) {
+		used = placement_parse_nice(argv, placement);
+	} else if (strcmp(argv[0], "taskset") == 0) {
+		used = placement_parse_taskset(argv, placement);
+	} else if (strcmp(argv[0], "ionice") == 0) {
+		used = placement_parse_ionice(argv, placement);
+	} else if (strcmp(argv[0], "cgexec") == 0) {
+		used = placement_parse_cgexec(argv, placement);
+	}
+	
+	if (used == 0 || argv[used] == NULL || argv[used][0] != '-') {
+		return used;
+	} else if (strcmp(argv[used], "--") == 0) {
+		return used + 1;
+	}
+	
+	return 0; /* An option for the real command. */
+}
+
+/**
+ * int placement_apply(const placement_t *placement)
+ *
+ * Applies the given placement to the calling process: joins the cgroup,
+ * then sets the CPU affinity, I/O priority and nice value. This is
+ * called in a child between fork() and exec(), so no wrapper process is
+ * needed.
+ *
+ * NOTE As with the nice command, failing to change the nice value (i.e.
+ *      lowering it without privilege) only prints a warning.
+ *
+ * Returns 0 if successful, -1 (after printing an error message) if
+ * unsuccessful.
+ */
+int placement_apply(const placement_t *placement) {
+	int priority;
+	
+	if (placement->cgroup[0] != '\0' && placement_join(placement->cgroup)
+			== -1) {
+		printf("!tmnsh: cgexec - %s - %s (%d)\n", placement->cgroup,
+				strerror(errno), errno);
+		return -1;
+	}
+	
+	if (placement->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t),
+			&placement->cpus) == -1) {
+		printf("!tmnsh: taskset - %s (%d)\n", strerror(errno), errno);
+		return -1;
+	}
+	
+	if (placement->has_ioprio && syscall(SYS_ioprio_set,
+			PLACEMENT_IOPRIO_WHO_PROCESS, 0, placement->ioprio) == -1) {
+		printf("!tmnsh: ionice - %s (%d)\n", strerror(errno), errno);
+		return -1;
+	}
+	
+	if (placement->has_nice) {
+		errno = 0;
+		priority = getpriority(PRIO_PROCESS, 0);
+		
+		if (errno != 0 || setpriority(PRIO_PROCESS, 0,
+				priority + placement->nice) == -1) {
+			printf("!tmnsh: nice - %s (%d)\n", strerror(errno), errno);
+		}
+	}
+	
+	return 0;
+}
+
+/**
+ * void placement_save(const placement_t *placement, placement_t *saved)
+ *
+ * Fills saved with the calling process's current value of each setting
+ * the given placement would change, so that applying saved afterwards
+ * undoes the placement (see interpret_exec()).
+ *
+ * NOTE Without privilege a raised nice value cannot be lowered again,
+ *      so applying saved then only prints a warning, as with nice.
+ */
+void placement_save(const placement_t *placement, placement_t *saved) {
+	int priority;
+	int target;
+	
+	placement_init(saved);
+	
+	if (placement->cgroup[0] != '\0' && placement_current(saved->cgroup)
+			== -1) {
+		saved->cgroup[0] = '\0';
+	}
+	
+	if (placement->has_cpus) {
+		saved->has_cpus = (sched_getaffinity(0, sizeof(cpu_set_t),
+				&saved->cpus) == 0);
+	}
+	
+	if (placement->has_ioprio) {
+		saved->ioprio = syscall(SYS_ioprio_get, PLACEMENT_IOPRIO_WHO_PROCESS,
+				0);
+		saved->has_ioprio = (saved->ioprio != -1);
+	}
+	
+	if (placement->has_nice) {
+		errno = 0;
+		priority = getpriority(PRIO_PROCESS, 0);
+		target = priority + placement->nice;
+		target = (target < -20 ? -20 : (target > 19 ? 19 : target));
+		
+		saved->nice = priority - target;
+		saved->has_nice = (errno == 0 && saved->nice != 0);
+	}
+}
+
+/**
+ * const placement_t *placement_background()
+ *
+ * Returns the placement set with the background builtin, which every
+ * background job starts from.
+ */
+const placement_t *placement_background() {
+	return &background_placement;
+}
+
+
+/***** Builtin Functions ****************************************************/
+
+/**
+ * int placement_background_command(command_t *cmd)
+ *
+ * The background builtin, i.e. "background nice -n 19 taskset -c 3
+ * ionice -c idle cgexec -g cpu,memory:batch". Sets the placement every
+ * later background job (and every stage of a background pipeline)
+ * starts from, using the same wrapper words as a command prefix. With no
+ * arguments, background jobs are placed like any other.
+ *
+ * Returns 0 if successful, 1 (after printing an error message) if
+ * unsuccessful.
+ */
+int placement_background_command(command_t *cmd) {
+	placement_t placement;
+	char **argv = &cmd->argv[1];
+	int used;
+	
+	placement_init(&placement);
+	
+	while (argv[0] != NULL) {
+		if ((used = placement_parse(argv, &placement)) == 0) {
+			printf("!tmnsh: background - not understood at \"%s\"\n",
+					argv[0]);
+			return 1;
+		}
+		
+		argv += used;
+	}
+	
+	background_placement = placement;
+	
+	return 0;
+}
+
+/**
+ * int placement_cgroup_command(command_t *cmd)
+ *
+ * The cgroup builtin, i.e. "cgroup batch cpu.max=50000 100000
+ * memory.max=2G". Creates the named group below the cgroup root if it
+ * does not already exist, enables the controller for each file given
+ * (the part before the dot) and then writes each value to its file.
+ * Commands are placed in the group with a "cgexec -g cpu,memory:batch"
+ * prefix, or by the background builtin.
+ *
+ * NOTE The tokeniser has no quoting, so a word which does not start a
+ *      setting (see placement_setting()) continues the value before it,
+ *      joined by a space, i.e. "io.max=8:0 rbps=1048576".
+ * NOTE If anything fails, the groups created by this call are removed
+ *      again, while groups which already existed are left alone.
+ *
+ * Returns 0 if successful, 1 (after printing an error message) if
+ * unsuccessful.
+ */
+int placement_cgroup_command(command_t *cmd) {
+	char dir[PLACEMENT_PATH_MAX_SIZE];
+	char value[PLACEMENT_PATH_MAX_SIZE];
+	char controller[64];
+	char file[256];
+	const char *root;
+	const char *name;
+	char *slash;
+	size_t existing = 0;
+	size_t length;
+	int failed = FALSE;
+	int next;
+	int i;
+	
+	if (cmd->num_args < 2) {
+		printf("!tmnsh: cgroup - usage: cgroup name [file=value ...]\n");
+		return 1;
+	}
+	
+	if ((root = placement_root()) == NULL) {
+		return 1;
+	}
+	
+	for (name = cmd->argv[1]; *name == '/'; name++);
+	
+	if (snprintf(dir, PLACEMENT_PATH_MAX_SIZE, "%s/%s", root, name) >=
+			PLACEMENT_PATH_MAX_SIZE) {
+		printf("!tmnsh: cgroup - %s - %s\n", name, strerror(ENAMETOOLONG));
+		return 1;
+	}
+	
+	/* Create the group and any missing parents, one level at a time,
+	 * remembering how much of the path already existed. */
+	for (slash = &dir[strlen(root)]; slash != NULL && !failed; ) {
+		if ((slash = strchr(&slash[1], '/')) != NULL) {
+			*slash = '\0';
+		}
+		
+		if (mkdir(dir, 0755) == 0) {
+			if (existing == 0) {
+				existing = strrchr(dir, '/') - dir;
+			}
+		} else if (errno != EEXIST) {
+			printf("!tmnsh: cgroup - %s - %s (%d)\n", dir, strerror(errno),
+					errno);
+			failed = TRUE;
+		}
+		
+		if (slash != NULL) {
+			*slash = '/';
+		}
+	}
+	
+	for (i = 2; i < cmd->num_args && !failed; i = next) {
+		length = strcspn(cmd->argv[i], "=");
+		
+		if (!placement_setting(cmd->argv[i]) || length >= sizeof(file)) {
+			printf("!tmnsh: cgroup - expected file=value, not \"%s\"\n",
+					cmd->argv[i]);
+			failed = TRUE;
+			break;
+		}
+		
+		snprintf(file, sizeof(file), "%.*s", (int)length, cmd->argv[i]);
+		snprintf(value, PLACEMENT_PATH_MAX_SIZE, "%s",
+				&cmd->argv[i][length + 1]);
+		
+		for (next = i + 1; next < cmd->num_args &&
+				!placement_setting(cmd->argv[next]); next++) {
+			length = strlen(value);
+			snprintf(&value[length], PLACEMENT_PATH_MAX_SIZE - length, " %s",
+					cmd->argv[next]);
+		}
+		
+		snprintf(controller, sizeof(controller), "%.*s",
+				(int)strcspn(file, "."), file);
+		
+		if (strcmp(controller, "cgroup") != 0 &&
+				placement_enable(root, name, controller) == -1) {
+			failed = TRUE;
+		} else if (placement_write(dir, file, value) == -1) {
+			printf("!tmnsh: cgroup - %s/%s - %s (%d)\n", dir, file,
+					strerror(errno), errno);
+			failed = TRUE;
+		}
+	}
+	
+	if (failed && existing != 0) {
+		placement_remove(dir, existing);
+	}
+	
+	return (failed ? 1 : 0);
+}
@@ -0,0 +1,62 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define PLACEMENT_PATH_MAX_SIZE 4097
+#define PLACEMENT_ROOT_VARIABLE "TMNSH_CGROUP_ROOT"
+#define PLACEMENT_SHELL_GROUP "tmnsh"
+#define PLACEMENT_DEFAULT_NICE 10
+#define PLACEMENT_DEFAULT_IOPRIO_LEVEL 4
+#define PLACEMENT_IOPRIO_CLASS_SHIFT 13
+#define PLACEMENT_IOPRIO_WHO_PROCESS 1
+
+
+/***** Structures ***********************************************************/
+
+/* Placement Structure - Where and how a child process is to run.
+ *
+ * NOTE Each setting is only applied if its has_ flag (or, for cgroup, a
+ *      non-empty path) is set. The nice value is an increment, as with
+ *      the nice command, while the I/O priority is the encoded value
+ *      passed to ioprio_set(). The cgroup is the full path of the
+ *      group's directory, already resolved against the cgroup root.
+ */
+typedef struct placement_s {
+	int has_cpus;
+	cpu_set_t cpus;
+	int has_nice;
+	int nice;
+	int has_ioprio;
+	int ioprio;
+	char cgroup[PLACEMENT_PATH_MAX_SIZE];
+	} placement_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Placement Functions */
+void placement_init(placement_t *placement);
+int placement_parse(char **argv, placement_t *placement);
+int placement_apply(const placement_t *placement);
+void placement_save(const placement_t *placement, placement_t *saved);
+const placement_t *placement_background();
+
+/* Builtin Functions */
+int placement_background_command(command_t *cmd);
+int placement_cgroup_command(command_t *cmd);
@@ -0,0 +1,258 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "expression.h"
+#include "input.h"
+#include "parser.h"
+#include "readahead.h"
+#include "cache.h"
+#include "tmnsh.h"
+
+
+/***** Read-ahead Queue Functions *******************************************/
+
+/**
+ * readahead_t *readahead_create(input_t *input)
+ *
+ * Returns a pointer to a new, empty read-ahead queue over the given
+ * input source. The pointer must be passed to readahead_destroy() once
+ * the queue is no longer needed.
+ *
+ * NOTE Only non-interactive sources should be read ahead. Reading ahead
+ *      on a terminal would swallow input meant for the running command.
+ */
+readahead_t *readahead_create(input_t *input) {
+	readahead_t *ra = malloc(sizeof(readahead_t));
+	
+	ra->input = input;
+	ra->cache = NULL;
+	ra->writer = NULL;
+	ra->more_to_read = TRUE;
+	ra->head = 0;
+	ra->num_entries = 0;
+	ra->max_entries = READAHEAD_MAX_ENTRIES;
+	
+	return ra;
+}
+
+/**
+ * void readahead_destroy(readahead_t *ra)
+ *
+ * Safely destroys a read-ahead queue by destroying any expressions still
+ * queued, closing its cache reader and abandoning any unfinished cache
+ * writer before passing the structure pointer to free().
+ */
+void readahead_destroy(readahead_t *ra) {
+	readahead_entry_t entry;
+	
+	ra->more_to_read = FALSE; /* Don't let readahead_pop() refill. */
+	
+	while (readahead_pop(ra, &entry) == TRUE) {
+		
+		if (entry.expr != NULL) {
+			expression_destroy(entry.expr);
+		}
+		
+		free(entry.line);
+		free(entry.message);
+	}
+	
+	if (ra->cache != NULL) {
+		cache_close(ra->cache);
+	}
+	
+	if (ra->writer != NULL) {
+		cache_writer_abandon(ra->writer);
+	}
+	
+	free(ra);
+}
+
+/**
+ * void readahead_set_cache(readahead_t *ra, struct cache_s *cache,
+ *                          struct cache_writer_s *writer)
+ *
+ * Gives the read-ahead queue a script cache to read entries from and/or
+ * a cache writer to record parsed entries with. The queue takes
+ * ownership of both; either may be NULL.
+ */
+void readahead_set_cache(readahead_t *ra, struct cache_s *cache,
+		struct cache_writer_s *writer) {
+	ra->cache = cache;
+	ra->writer = writer;
+}
+
+/**
+ * void readahead_parse(readahead_entry_t *entry, char *buffer,
+ *                      const char *line)
+ *
+ * Tokenises and parses the given buffer into the given entry. The buffer
+ * is modified by the tokeniser, so an unmodified copy of the line must
+ * be supplied for error reporting. Syntax errors are kept in the entry
+ * rather than printed, as the line may not be reached for some time.
+ */
+static void readahead_parse(readahead_entry_t *entry, char *buffer,
+		const char *line) {
+	char message[PARSER_ERROR_MAX_SIZE];
+	tokarray_t *tokens;
+	
+	entry->error = READAHEAD_OK;
+	entry->expr = NULL;
+	entry->line = NULL;
+	entry->message = NULL;
+	
+	tokens = tokenise_input(buffer);
+	
+	if (tokens == NULL) {
+		entry->error = READAHEAD_TOKENISE_ERROR;
+	} else {
+		entry->expr = parse_tokens_error(tokens, message);
+		tokarray_destroy(tokens);
+		
+		if (entry->expr == NULL) {
+			entry->error = READAHEAD_PARSE_ERROR;
+		}
+		
+		if (message[0] != '\0') {
+			entry->message = malloc(strlen(message) + 1);
+			strcpy(entry->message, message);
+		}
+	}
+	
+	if (entry->error != READAHEAD_OK) {
+		entry->line = malloc(strlen(line) + 1);
+		strcpy(entry->line, line);
+	}
+}
+
+/**
+ * int readahead_fill(readahead_t *ra)
+ *
+ * Reads, tokenises and parses a single line of input, adding the result
+ * to the back of the queue. Lines which fail to tokenise or parse are
+ * queued as errors. Nothing is ever evaluated here, so builtins such as
+ * cd that change the shell's state are unaffected by reading ahead.
+ *
+ * NOTE With a cache reader the next entry is taken from the cache
+ *      instead. With a cache writer the cache is completed as soon as
+ *      the end of the input is reached.
+ *
+ * Returns TRUE if a line was read, FALSE if the queue is full or there
+ * is no more input.
+ */
+int readahead_fill(readahead_t *ra) {
+	char buffer[BUFFER_MAX_SIZE];
+	char last_line[BUFFER_MAX_SIZE];
+	readahead_entry_t *entry;
+	
+	if (ra->more_to_read == FALSE || ra->num_entries >= ra->max_entries) {
+		return FALSE;
+	}
+	
+	entry = &ra->entries[(ra->head + ra->num_entries) % ra->max_entries];
+	
+	if (ra->cache != NULL) {
+		ra->more_to_read = cache_read_entry(ra->cache, entry);
+		
+		if (ra->more_to_read == TRUE) {
+			ra->num_entries++;
+		}
+		
+		return ra->more_to_read;
+	}
+	
+	ra->more_to_read = input_read_line(ra->input, buffer, BUFFER_MAX_SIZE);
+	
+	if (strlen(buffer) != 0) {
+		strcpy(last_line, buffer);
+		readahead_parse(entry, buffer, last_line);
+		
+		if (ra->writer != NULL) {
+			cache_write_entry(ra->writer, entry);
+		}
+		
+		ra->num_entries++;
+	}
+	
+	if (ra->more_to_read == FALSE && ra->writer != NULL) {
+		cache_writer_finish(ra->writer);
+		ra->writer = NULL;
+	}
+	
+	return TRUE;
+}
+
+/**
+ * int readahead_idle(void *data)
+ *
+ * An idle hook for interpret_set_idle_hook() which reads ahead one line
+ * into the read-ahead queue given as data.
+ *
+ * Returns TRUE if there may be more to read ahead, FALSE otherwise.
+ */
+int readahead_idle(void *data) {
+	return readahead_fill((readahead_t *) data);
+}
+
+/**
+ * int readahead_pop(readahead_t *ra, readahead_entry_t *entry)
+ *
+ * Removes the entry at the front of the queue, copying it into the entry
+ * supplied. If the queue is empty, input is read until an entry can be
+ * returned. Ownership of the entry's expression and line passes to the
+ * caller.
+ *
+ * Returns TRUE if an entry was removed, FALSE if there is no more input.
+ */
+int readahead_pop(readahead_t *ra, readahead_entry_t *entry) {
+	while (ra->num_entries == 0) {
+		if (readahead_fill(ra) == FALSE) {
+			return FALSE;
+		}
+	}
+	
+	*entry = ra->entries[ra->head];
+	ra->head = (ra->head + 1) % ra->max_entries;
+	ra->num_entries--;
+	
+	return TRUE;
+}
+
+/**
+ * int readahead_at_end(readahead_t *ra)
+ *
+ * Checks whether any more entries follow, reading ahead over blank lines
+ * if the queue is empty.
+ *
+ * Returns TRUE if no more entries can be popped, FALSE otherwise.
+ */
+int readahead_at_end(readahead_t *ra) {
+	while (ra->num_entries == 0) {
+		if (readahead_fill(ra) == FALSE) {
+			return TRUE;
+		}
+	}
+	
+	return FALSE;
+}
@@ -0,0 +1,76 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define READAHEAD_MAX_ENTRIES 64
+
+#define READAHEAD_OK 0
+#define READAHEAD_TOKENISE_ERROR 1
+#define READAHEAD_PARSE_ERROR 2
+
+
+/***** Structures ***********************************************************/
+
+struct cache_s;
+struct cache_writer_s;
+
+/* Read-ahead Entry Structure
+ *
+ * NOTE The line is only kept for entries which failed to tokenise or
+ *      parse, so that the error can be reported in order. The message is
+ *      the parser's own syntax error for the line, if it gave one, held
+ *      back until the entry is reached rather than printed while reading
+ *      ahead.
+ */
+typedef struct readahead_entry_s {
+	int error;
+	expression_t *expr;
+	char *line;
+	char *message;
+	} readahead_entry_t;
+
+/* Read-ahead Queue Structure
+ *
+ * NOTE If a cache reader is set, entries come from the cache rather than
+ *      the input source. If a cache writer is set, every entry parsed
+ *      from the input source is also written to the cache.
+ */
+typedef struct readahead_s {
+	input_t *input;
+	struct cache_s *cache;
+	struct cache_writer_s *writer;
+	int more_to_read;
+	int head;
+	int num_entries;
+	int max_entries;
+	readahead_entry_t entries[READAHEAD_MAX_ENTRIES];
+	} readahead_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Read-ahead Queue Functions */
+readahead_t *readahead_create(input_t *input);
+void readahead_destroy(readahead_t *ra);
+void readahead_set_cache(readahead_t *ra, struct cache_s *cache,
+		struct cache_writer_s *writer);
+int readahead_fill(readahead_t *ra);
+int readahead_idle(void *data);
+int readahead_pop(readahead_t *ra, readahead_entry_t *entry);
+int readahead_at_end(readahead_t *ra);
@@ -0,0 +1,313 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+#include "scan.h"
+#include "tmnsh.h"
+
+
+/***** Kernel Selection *****************************************************/
+
+/* NOTE The kernels are chosen once, on first use, according to what the
+ *      CPU we are actually running on supports. pthread_once() makes sure
+ *      they are only ever written once, whichever filter thread gets
+ *      there first.
+ */
+static pthread_once_t kernels_chosen = PTHREAD_ONCE_INIT;
+static unsigned long (*count_kernel)(const char *data, unsigned long size,
+		char byte) = NULL;
+static const char *(*find_kernel)(const char *data, unsigned long size,
+		const char *needle, unsigned long needle_size) = NULL;
+
+
+/***** Scalar Kernels *******************************************************/
+
+/**
+ * unsigned long scan_count_scalar(const char *data, unsigned long size,
+ *                                 char byte)
+ *
+ * Returns the number of times byte occurs in the given data.
+ */
+static unsigned long scan_count_scalar(const char *data, unsigned long size,
+		char byte) {
+	unsigned long count = 0;
+	const char *end = data + size;
+	
+	while ((data = memchr(data, byte, end - data)) != NULL) {
+		count++;
+		data++;
+	}
+	
+	return count;
+}
+
+/**
+ * const char *scan_find_scalar(const char *data, unsigned long size,
+ *                              const char *needle,
+ *                              unsigned long needle_size)
+ *
+ * Returns a pointer to the first occurrence of needle in the given data,
+ * or NULL if there is none. The needle must be at least one byte long.
+ */
+static const char *scan_find_scalar(const char *data, unsigned long size,
+		const char *needle, unsigned long needle_size) {
+	const char *last;
+	
+	if (size < needle_size) {
+		return NULL;
+	}
+	
+	last = data + size - needle_size;
+	
+	while (data <= last) {
+		data = memchr(data, needle[0], last - data + 1);
+		
+		if (data == NULL) {
+			return NULL;
+		}
+		
+		if (memcmp(data + 1, needle + 1, needle_size - 1) == 0) {
+			return data;
+		}
+		
+		data++;
+	}
+	
+	return NULL;
+}
+
+
+#ifdef SCAN_X86
+
+/***** SSE2 Kernels *********************************************************/
+
+/**
+ * unsigned long scan_count_sse2(const char *data, unsigned long size,
+ *                               char byte)
+ *
+ * As scan_count_scalar(), sixteen bytes at a time.
+ */
+__attribute__((target("sse2")))
+static unsigned long scan_count_sse2(const char *data, unsigned long size,
+		char byte) {
+	__m128i pattern = _mm_set1_epi8(byte);
+	__m128i block;
+	unsigned long count = 0;
+	unsigned long offset = 0;
+	
+	for (; offset + 16 <= size; offset += 16) {
+		block = _mm_loadu_si128((const __m128i *) (data + offset));
+		count += __builtin_popcount(
+				_mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern)));
+	}
+	
+	return count + scan_count_scalar(data + offset, size - offset, byte);
+}
+
+/**
+ * const char *scan_find_sse2(const char *data, unsigned long size,
+ *                            const char *needle,
+ *                            unsigned long needle_size)
+ *
+ * As scan_find_scalar(), testing sixteen candidate positions at a time.
+ * A position is only compared in full if both the first and the last
+ * byte of the needle match there, which rules out almost every position
+ * without a branch.
+ */
+__attribute__((target("sse2")))
+static const char *scan_find_sse2(const char *data, unsigned long size,
+		const char *needle, unsigned long needle_size) {
+	__m128i first = _mm_set1_epi8(needle[0]);
+	__m128i last = _mm_set1_epi8(needle[needle_size - 1]);
+	__m128i block_first;
+	__m128i block_last;
+	unsigned int mask;
+	unsigned long offset = 0;
+	int bit;
+	
+	for (; offset + needle_size - 1 + 16 <= size; offset += 16) {
+		block_first = _mm_loadu_si128((const __m128i *) (data + offset));
+		block_last = _mm_loadu_si128(
+				(const __m128i *) (data + offset + needle_size - 1));
+		mask = _mm_movemask_epi8(_mm_and_si128(
+				_mm_cmpeq_epi8(block_first, first),
+				_mm_cmpeq_epi8(block_last, last)));
+		
+		while (mask != 0) {
+			bit = __builtin_ctz(mask);
+			
+			if (memcmp(data + offset + bit + 1, needle + 1,
+					needle_size - 1) == 0) {
+				return data + offset + bit;
+			}
+			
+			mask &= mask - 1;
+		}
+	}
+	
+	return scan_find_scalar(data + offset, size - offset, needle,
+			needle_size);
+}
+
+
+/***** AVX2 Kernels *********************************************************/
+
+/**
+ * unsigned long scan_count_avx2(const char *data, unsigned long size,
+ *                               char byte)
+ *
+ * As scan_count_scalar(), thirty-two bytes at a time.
+ */
+__attribute__((target("avx2")))
+static unsigned long scan_count_avx2(const char *data, unsigned long size,
+		char byte) {
+	__m256i pattern = _mm256_set1_epi8(byte);
+	__m256i block;
+	unsigned long count = 0;
+	unsigned long offset = 0;
+	
+	for (; offset + 32 <= size; offset += 32) {
+		block = _mm256_loadu_si256((const __m256i *) (data + offset));
+		count += __builtin_popcount(
+				_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, pattern)));
+	}
+	
+	return count + scan_count_scalar(data + offset, size - offset, byte);
+}
+
+/**
+ * const char *scan_find_avx2(const char *data, unsigned long size,
+ *                            const char *needle,
+ *                            unsigned long needle_size)
+ *
+ * As scan_find_sse2(), testing thirty-two candidate positions at a time.
+ */
+__attribute__((target("avx2")))
+static const char *scan_find_avx2(const char *data, unsigned long size,
+		const char *needle, unsigned long needle_size) {
+	__m256i first = _mm256_set1_epi8(needle[0]);
+	__m256i last = _mm256_set1_epi8(needle[needle_size - 1]);
+	__m256i block_first;
+	__m256i block_last;
+	unsigned int mask;
+	unsigned long offset = 0;
+	int bit;
+	
+	for (; offset + needle_size - 1 + 32 <= size; offset += 32) {
+		block_first = _mm256_loadu_si256((const __m256i *) (data + offset));
+		block_last = _mm256_loadu_si256(
+				(const __m256i *) (data + offset + needle_size - 1));
+		mask = _mm256_movemask_epi8(_mm256_and_si256(
+				_mm256_cmpeq_epi8(block_first, first),
+				_mm256_cmpeq_epi8(block_last, last)));
+		
+		while (mask != 0) {
+			bit = __builtin_ctz(mask);
+			
+			if (memcmp(data + offset + bit + 1, needle + 1,
+					needle_size - 1) == 0) {
+				return data + offset + bit;
+			}
+			
+			mask &= mask - 1;
+		}
+	}
+	
+	return scan_find_scalar(data + offset, size - offset, needle,
+			needle_size);
+}
+
+#endif /* SCAN_X86 */
+
+
+/***** Scan Kernels *********************************************************/
+
+/**
+ * void scan_choose()
+ *
+ * Chooses the fastest kernels the CPU supports. Only ever called once,
+ * through scan_init().
+ */
+static void scan_choose() {
+	count_kernel = scan_count_scalar;
+	find_kernel = scan_find_scalar;
+	
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	
+	if (__builtin_cpu_supports("avx2")) {
+		count_kernel = scan_count_avx2;
+		find_kernel = scan_find_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		count_kernel = scan_count_sse2;
+		find_kernel = scan_find_sse2;
+	}
+#endif
+}
+
+/**
+ * void scan_init()
+ *
+ * Chooses the kernels if that has not been done yet. This happens on
+ * first use anyway, and is safe to call from any thread.
+ */
+void scan_init() {
+	pthread_once(&kernels_chosen, scan_choose);
+}
+
+/**
+ * unsigned long scan_count(const char *data, unsigned long size,
+ *                          char byte)
+ *
+ * Returns the number of times byte occurs in the given data.
+ */
+unsigned long scan_count(const char *data, unsigned long size, char byte) {
+	scan_init();
+	
+	return count_kernel(data, size, byte);
+}
+
+/**
+ * const char *scan_find(const char *data, unsigned long size,
+ *                       const char *needle, unsigned long needle_size)
+ *
+ * Returns a pointer to the first occurrence of needle in the given data,
+ * or NULL if there is none. An empty needle is found at the start of the
+ * data.
+ */
+const char *scan_find(const char *data, unsigned long size,
+		const char *needle, unsigned long needle_size) {
+	if (needle_size == 0) {
+		return data;
+	} else if (needle_size == 1) {
+		return memchr(data, needle[0], size);
+	}
+	
+	scan_init();
+	
+	return find_kernel(data, size, needle, needle_size);
+}
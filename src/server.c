@@ -0,0 +1,378 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pathhash.h"
+#include "server.h"
+#include "tmnsh.h"
+
+
+/***** Socket Functions *****************************************************/
+
+/**
+ * int server_read(int fd, void *buffer, unsigned long size)
+ *
+ * Reads exactly size bytes from the given socket.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+static int server_read(int fd, void *buffer, unsigned long size) {
+	char *buf = buffer;
+	long result;
+	
+	while (size > 0) {
+		result = read(fd, buf, size);
+		
+		if (result == -1 && errno == EINTR) {
+			continue;
+		} else if (result <= 0) {
+			return -1;
+		}
+		
+		buf += result;
+		size -= result;
+	}
+	
+	return 0;
+}
+
+/**
+ * int server_receive_request(int fd, server_request_t *request,
+ *                            int fds[SERVER_NUM_FDS])
+ *
+ * Receives a request header, along with the client's standard input,
+ * output and error, from the given socket.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+static int server_receive_request(int fd, server_request_t *request,
+		int fds[SERVER_NUM_FDS]) {
+	char control[CMSG_SPACE(sizeof(int) * SERVER_NUM_FDS)];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	long result;
+	
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = request;
+	iov.iov_len = sizeof(server_request_t);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	
+	do {
+		result = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	} while (result == -1 && errno == EINTR);
+	
+	cmsg = CMSG_FIRSTHDR(&msg);
+	
+	if (result <= 0 || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+			cmsg->cmsg_type != SCM_RIGHTS ||
+			cmsg->cmsg_len != CMSG_LEN(sizeof(int) * SERVER_NUM_FDS)) {
+		return -1;
+	}
+	
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * SERVER_NUM_FDS);
+	
+	/* The rest of the header may arrive separately. */
+	if (server_read(fd, (char *) request + result,
+			sizeof(server_request_t) - result) == -1 ||
+			request->magic != SERVER_MAGIC ||
+			request->version != SERVER_VERSION ||
+			request->cwd_size == 0 ||
+			request->env_size > SERVER_ENV_MAX_SIZE ||
+			request->script_size > SERVER_SCRIPT_MAX_SIZE) {
+		return -1;
+	}
+	
+	return 0;
+}
+
+
+/**
+ * void server_set_environment(char *env, unsigned long size)
+ *
+ * Replaces the worker's environment with the client's, given as size
+ * bytes of NUL-terminated "name=value" strings. If that changes PATH,
+ * the path hash filled by the server is forgotten, so that commands are
+ * looked up on the client's PATH instead.
+ *
+ * NOTE The strings are used in place, so env must not be freed.
+ */
+static void server_set_environment(char *env, unsigned long size) {
+	const char *path = getenv("PATH");
+	char *old_path = NULL;
+	unsigned long offset;
+	
+	if (path != NULL) {
+		old_path = malloc(strlen(path) + 1);
+		strcpy(old_path, path);
+	}
+	
+	clearenv();
+	
+	for (offset = 0; offset < size; offset += strlen(&env[offset]) + 1) {
+		if (strchr(&env[offset], '=') != NULL) {
+			putenv(&env[offset]);
+		}
+	}
+	
+	path = getenv("PATH");
+	
+	if ((path == NULL) != (old_path == NULL) ||
+			(path != NULL && strcmp(path, old_path) != 0)) {
+		pathhash_clear();
+	}
+	
+	free(old_path);
+}
+
+
+/***** Worker Table Functions *********************************************/
+
+/**
+ * void server_add_worker(server_worker_t **workers, int *num_workers,
+ *                        pid_t pid, int client_fd)
+ *
+ * Remembers that the given worker is serving the given client.
+ */
+static void server_add_worker(server_worker_t **workers, int *num_workers,
+		pid_t pid, int client_fd) {
+	*workers = realloc(*workers, sizeof(server_worker_t) * (*num_workers + 1));
+	(*workers)[*num_workers].pid = pid;
+	(*workers)[*num_workers].client_fd = client_fd;
+	(*num_workers)++;
+}
+
+/**
+ * void server_reap_workers(server_worker_t *workers, int *num_workers)
+ *
+ * Waits for every worker which has finished, sending its exit status to
+ * its client and closing the connection.
+ */
+static void server_reap_workers(server_worker_t *workers, int *num_workers) {
+	int status;
+	int index;
+	pid_t pid;
+	
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) :
+				WEXITSTATUS(status);
+		
+		for (index = 0; index < *num_workers; index++) {
+			if (workers[index].pid == pid) {
+				send(workers[index].client_fd, &status, sizeof(status),
+						MSG_NOSIGNAL);
+				close(workers[index].client_fd);
+				workers[index] = workers[--(*num_workers)];
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * void server_sigchld_handler(int sig)
+ *
+ * Does nothing; SIGCHLD only needs to interrupt ppoll() in server_run().
+ */
+static void server_sigchld_handler(int sig) {
+}
+
+
+/***** Server Functions *****************************************************/
+
+/**
+ * void server_handle(int client_fd)
+ *
+ * Runs a single client's request in a freshly forked worker. The
+ * worker takes on the client's standard input, output and error,
+ * working directory and environment, and runs the script as "tmnsh -c"
+ * would, including replacing itself with the script's final command.
+ * The server sends the worker's exit status back to the client.
+ *
+ * NOTE The received descriptors are first moved above the standard
+ *      ones, since any of them may have been given a number from 0 to 2
+ *      (i.e. when the server was started with those closed) and would
+ *      otherwise be overwritten or closed before being put in place.
+ * NOTE This is only ever called in the worker, and never returns.
+ */
+void server_handle(int client_fd) {
+	server_request_t request;
+	int fds[SERVER_NUM_FDS];
+	char *script;
+	char *env;
+	char *cwd;
+	int status;
+	int index;
+	int fd;
+	
+	if (server_receive_request(client_fd, &request, fds) == -1) {
+		_exit(1);
+	}
+	
+	cwd = malloc(request.cwd_size + 1);
+	env = malloc(request.env_size + 1);
+	script = malloc(request.script_size + 1);
+	
+	if (server_read(client_fd, cwd, request.cwd_size) == -1 ||
+			server_read(client_fd, env, request.env_size) == -1 ||
+			server_read(client_fd, script, request.script_size) == -1) {
+		_exit(1);
+	}
+	
+	cwd[request.cwd_size] = '\0';
+	env[request.env_size] = '\0';
+	script[request.script_size] = '\0';
+	
+	for (index = 0; index < SERVER_NUM_FDS; index++) {
+		if (fds[index] < SERVER_NUM_FDS) {
+			if ((fd = fcntl(fds[index], F_DUPFD, SERVER_NUM_FDS)) == -1) {
+				_exit(1);
+			}
+			
+			close(fds[index]);
+			fds[index] = fd;
+		}
+	}
+	
+	for (index = 0; index < SERVER_NUM_FDS; index++) {
+		dup2(fds[index], index);
+		close(fds[index]);
+	}
+	
+	server_set_environment(env, request.env_size);
+	
+	if (chdir(cwd) == -1) {
+		printf("!tmnsh: cd - %s (%d)\n", strerror(errno), errno);
+		status = 1;
+	} else {
+		status = run_command_string(script);
+	}
+	
+	fflush(stdout);
+	
+	_exit(status);
+}
+
+/**
+ * int server_run(const char *socket_path)
+ *
+ * Listens on a Unix domain socket at the given path, handing each client
+ * that connects to a forked worker (see server_handle()). Workers are
+ * forked from a long-lived, already warmed-up shell, so they start with
+ * the path hash filled and without paying for the shell's own startup.
+ *
+ * NOTE The socket is only accessible to its owner.
+ *
+ * Returns 1 if the server could not be started, otherwise never returns.
+ */
+int server_run(const char *socket_path) {
+	server_worker_t *workers = NULL;
+	struct sockaddr_un address;
+	struct pollfd listener;
+	sigset_t blocked;
+	sigset_t unblocked;
+	mode_t mask;
+	int num_workers = 0;
+	int client_fd;
+	int num_found;
+	pid_t pid;
+	
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		printf("!tmnsh: Socket path too long: %s\n", socket_path);
+		return 1;
+	}
+	
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+	
+	listener.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	listener.events = POLLIN;
+	unlink(socket_path);
+	
+	mask = umask(077);
+	
+	if (listener.fd == -1 ||
+			bind(listener.fd, (struct sockaddr *) &address, sizeof(address)) ||
+			listen(listener.fd, SERVER_BACKLOG) == -1) {
+		printf("!tmnsh: %s - %s (%d)\n", socket_path, strerror(errno), errno);
+		return 1;
+	}
+	
+	umask(mask);
+	
+	/* SIGCHLD is only let through while waiting for clients. */
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &blocked, &unblocked);
+	sigdelset(&unblocked, SIGCHLD);
+	signal(SIGCHLD, server_sigchld_handler);
+	signal(SIGINT, SIG_DFL);
+	
+	num_found = pathhash_scan(NULL, NULL);
+	printf("tmnsh: Serving on %s (%d commands hashed).\n", socket_path,
+			num_found);
+	fflush(stdout);
+	
+	while (TRUE) {
+		server_reap_workers(workers, &num_workers);
+		
+		if (ppoll(&listener, 1, NULL, &unblocked) <= 0) {
+			continue;
+		}
+		
+		client_fd = accept4(listener.fd, NULL, NULL, SOCK_CLOEXEC);
+		
+		if (client_fd == -1) {
+			continue;
+		}
+		
+		pid = fork();
+		
+		if (pid == 0) {
+			close(listener.fd);
+			signal(SIGCHLD, SIG_DFL);
+			sigprocmask(SIG_SETMASK, &unblocked, NULL);
+			server_handle(client_fd);
+		} else if (pid == -1) {
+			close(client_fd);
+		} else {
+			server_add_worker(&workers, &num_workers, pid, client_fd);
+		}
+	}
+	
+	return 0;
+}
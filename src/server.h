@@ -0,0 +1,59 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define SERVER_MAGIC 0x544d4e53 /* "TMNS" */
+#define SERVER_VERSION 2
+#define SERVER_BACKLOG 128
+#define SERVER_NUM_FDS 3
+#define SERVER_SCRIPT_MAX_SIZE (64 * 1024 * 1024)
+#define SERVER_ENV_MAX_SIZE (16 * 1024 * 1024)
+
+
+/***** Structures ***********************************************************/
+
+/* Server Request Structure
+ *
+ * NOTE A request is sent by tmnshc with the client's standard input,
+ *      output and error attached as SCM_RIGHTS ancillary data, and is
+ *      followed on the socket by cwd_size bytes of working directory,
+ *      env_size bytes of environment (each "name=value" string followed
+ *      by a NUL) and script_size bytes of script. The reply is a single
+ *      int holding the script's exit status.
+ */
+typedef struct server_request_s {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int cwd_size;
+	unsigned int env_size;
+	unsigned int script_size;
+	} server_request_t;
+
+/* Server Worker Structure - A worker and the client it is serving. */
+typedef struct server_worker_s {
+	pid_t pid;
+	int client_fd;
+	} server_worker_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Server Functions */
+int server_run(const char *socket_path);
+void server_handle(int client_fd);
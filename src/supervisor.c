@@ -0,0 +1,447 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Includes *************************************************************/
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "supervisor.h"
+#include "tmnsh.h"
+
+
+/***** Globals **************************************************************/
+
+/* Event Loop - Watches for child exits, job timeouts and input. */
+static int epoll_fd = -1;
+static int signal_fd = -1;
+static sigset_t child_mask;
+
+/* Jobs - Every child process not yet reaped. */
+static job_t *jobs = NULL;
+
+/* Marks the input descriptor's events, as opposed to a job's timer. */
+static int input_marker;
+
+
+/***** Supervisor Functions *************************************************/
+
+/**
+ * int supervisor_init()
+ *
+ * Starts supervising child processes. SIGCHLD is blocked and read from a
+ * signalfd instead, so child exits are handled by the event loop in
+ * supervisor_wait() rather than by a signal handler which could run at
+ * any time (and reap a child someone else is waiting for). Calling this
+ * again once supervision has started does nothing.
+ *
+ * NOTE Every child forked afterwards must call supervisor_child() before
+ *      exec'ing, so that it doesn't inherit the blocked SIGCHLD.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+int supervisor_init() {
+	struct epoll_event event;
+	sigset_t mask;
+	
+	if (epoll_fd != -1) {
+		return 0;
+	}
+	
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	
+	signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	
+	if (signal_fd == -1 || epoll_fd == -1 ||
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event) == -1) {
+		if (signal_fd != -1) {
+			close(signal_fd);
+		}
+		
+		if (epoll_fd != -1) {
+			close(epoll_fd);
+		}
+		
+		signal_fd = -1;
+		epoll_fd = -1;
+		return -1;
+	}
+	
+	signal(SIGCHLD, SIG_DFL);
+	sigprocmask(SIG_BLOCK, &mask, &child_mask);
+	
+	return 0;
+}
+
+/**
+ * int supervisor_active()
+ *
+ * Returns TRUE if child processes are being supervised, FALSE otherwise.
+ */
+int supervisor_active() {
+	return (epoll_fd != -1);
+}
+
+/**
+ * void supervisor_child()
+ *
+ * Restores the signal mask the shell started with and stops supervising
+ * in this process, since the event loop and the jobs belong to the
+ * shell. Must be called in every child process forked while supervision
+ * is active.
+ *
+ * NOTE A child which goes on to start processes of its own (i.e. to run
+ *      a memo builtin in a pipeline) then waits for them with waitpid().
+ */
+void supervisor_child() {
+	if (epoll_fd != -1) {
+		sigprocmask(SIG_SETMASK, &child_mask, NULL);
+		close(epoll_fd);
+		close(signal_fd);
+		epoll_fd = -1;
+		signal_fd = -1;
+		jobs = NULL;
+	}
+}
+
+/**
+ * int supervisor_exit_status(int wait_status)
+ *
+ * Returns the exit status a shell reports for a child with the given
+ * wait status: the child's exit status, or 128 plus the signal number if
+ * the child was killed by a signal.
+ */
+int supervisor_exit_status(int wait_status) {
+	if (WIFSIGNALED(wait_status)) {
+		return 128 + WTERMSIG(wait_status);
+	}
+	
+	return WEXITSTATUS(wait_status);
+}
+
+
+/***** Job Functions ********************************************************/
+
+/**
+ * job_t *supervisor_find(pid_t pid)
+ *
+ * Returns the job for the given process, or NULL if there is none.
+ */
+static job_t *supervisor_find(pid_t pid) {
+	job_t *job;
+	
+	for (job = jobs; job != NULL; job = job->next) {
+		if (job->pid == pid) {
+			return job;
+		}
+	}
+	
+	return NULL;
+}
+
+/**
+ * void supervisor_remove(job_t *job)
+ *
+ * Forgets the given job, stopping its timer and freeing it.
+ */
+static void supervisor_remove(job_t *job) {
+	job_t **link;
+	
+	for (link = &jobs; *link != NULL; link = &(*link)->next) {
+		if (*link == job) {
+			*link = job->next;
+			break;
+		}
+	}
+	
+	if (job->timer_fd != -1) {
+		close(job->timer_fd);
+	}
+	
+	free(job);
+}
+
+/**
+ * void supervisor_add(pid_t pid, int background)
+ *
+ * Starts supervising the given child process. Background jobs are
+ * forgotten as soon as they finish; foreground jobs are kept until they
+ * are waited for with supervisor_wait().
+ */
+void supervisor_add(pid_t pid, int background) {
+	job_t *job;
+	
+	if (epoll_fd == -1 || pid <= 0) {
+		return;
+	}
+	
+	job = malloc(sizeof(job_t));
+	job->pid = pid;
+	job->background = background;
+	job->done = FALSE;
+	job->status = 0;
+	job->timed_out = FALSE;
+	job->timer_fd = -1;
+	job->next = jobs;
+	jobs = job;
+}
+
+/**
+ * int supervisor_set_timeout(pid_t pid, double seconds)
+ *
+ * Arranges for the given job to be sent SIGTERM if it is still running
+ * after the given number of seconds, using a timerfd watched by the
+ * event loop. As with coreutils timeout, a duration of 0 means no
+ * timeout at all.
+ *
+ * Returns 0 if successful, -1 if unsuccessful.
+ */
+int supervisor_set_timeout(pid_t pid, double seconds) {
+	job_t *job = supervisor_find(pid);
+	struct itimerspec timeout;
+	struct epoll_event event;
+	
+	if (job == NULL || job->timer_fd != -1) {
+		return -1;
+	} else if (seconds == 0) {
+		return 0;
+	}
+	
+	memset(&timeout, 0, sizeof(timeout));
+	timeout.it_value.tv_sec = (time_t) seconds;
+	timeout.it_value.tv_nsec = (long) ((seconds - (time_t) seconds) * 1e9);
+	
+	if (timeout.it_value.tv_sec == 0 && timeout.it_value.tv_nsec == 0) {
+		timeout.it_value.tv_nsec = 1; /* Round up, as zero disarms it. */
+	}
+	
+	job->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+			TFD_NONBLOCK | TFD_CLOEXEC);
+	
+	event.events = EPOLLIN;
+	event.data.ptr = job;
+	
+	if (job->timer_fd == -1 ||
+			timerfd_settime(job->timer_fd, 0, &timeout, NULL) == -1 ||
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, job->timer_fd, &event) == -1) {
+		if (job->timer_fd != -1) {
+			close(job->timer_fd);
+			job->timer_fd = -1;
+		}
+		
+		return -1;
+	}
+	
+	return 0;
+}
+
+/**
+ * void supervisor_reap()
+ *
+ * Reaps every child which has finished, marking its job done and
+ * recording its exit status.
+ */
+static void supervisor_reap() {
+	struct signalfd_siginfo info;
+	job_t *job;
+	int status;
+	pid_t pid;
+	
+	/* Several exits may be merged into a single SIGCHLD. */
+	while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+	}
+	
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		job = supervisor_find(pid);
+		
+		if (job == NULL) {
+			continue;
+		}
+		
+		job->done = TRUE;
+		job->status = job->timed_out ? SUPERVISOR_TIMEOUT_STATUS :
+				supervisor_exit_status(status);
+		
+		if (job->timer_fd != -1) {
+			close(job->timer_fd);
+			job->timer_fd = -1;
+		}
+	}
+}
+
+/**
+ * void supervisor_exec_begin()
+ *
+ * Restores the signal mask the shell started with, just before the shell
+ * replaces itself with execvp(). Supervision is otherwise left alone:
+ * its descriptors are close-on-exec, and if the exec fails the shell
+ * carries on with its jobs (see supervisor_exec_failed()).
+ */
+void supervisor_exec_begin() {
+	if (epoll_fd != -1) {
+		sigprocmask(SIG_SETMASK, &child_mask, NULL);
+	}
+}
+
+/**
+ * void supervisor_exec_failed()
+ *
+ * Resumes supervision after supervisor_exec_begin() when the exec has
+ * failed. SIGCHLD is blocked again and any child which finished while it
+ * was not is reaped, since that SIGCHLD never reached the signalfd.
+ */
+void supervisor_exec_failed() {
+	sigset_t mask;
+	
+	if (epoll_fd != -1) {
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &mask, NULL);
+		supervisor_reap();
+	}
+}
+
+/**
+ * int supervisor_dispatch(int timeout)
+ *
+ * Waits at most timeout milliseconds (or forever, if timeout is -1) for
+ * events and handles them: child exits are reaped, timed out jobs are
+ * sent SIGTERM and finished background jobs are forgotten.
+ *
+ * Returns TRUE if the input descriptor (if any) became readable, FALSE
+ * otherwise.
+ */
+static int supervisor_dispatch(int timeout) {
+	struct epoll_event events[SUPERVISOR_MAX_EVENTS];
+	job_t *job;
+	job_t *next;
+	int input_ready = FALSE;
+	int num_events;
+	int index;
+	
+	num_events = epoll_wait(epoll_fd, events, SUPERVISOR_MAX_EVENTS, timeout);
+	
+	for (index = 0; index < num_events; index++) {
+		if (events[index].data.ptr == NULL) {
+			supervisor_reap();
+		} else if (events[index].data.ptr == &input_marker) {
+			input_ready = TRUE;
+		} else {
+			job = events[index].data.ptr;
+			
+			if (!job->done && !job->timed_out) {
+				kill(job->pid, SIGTERM);
+				job->timed_out = TRUE;
+			}
+			
+			if (job->timer_fd != -1) {
+				close(job->timer_fd);
+				job->timer_fd = -1;
+			}
+		}
+	}
+	
+	/* Only now that no event can refer to them, forget background jobs. */
+	for (job = jobs; job != NULL; job = next) {
+		next = job->next;
+		
+		if (job->done && job->background) {
+			supervisor_remove(job);
+		}
+	}
+	
+	return input_ready;
+}
+
+/**
+ * int supervisor_wait(pid_t pid, int (*hook)(void *data), void *data)
+ *
+ * Runs the event loop until the given foreground job finishes, while
+ * other jobs finish and time out around it. If a hook is given it is
+ * called with data between polls until it returns FALSE, for work the
+ * shell can do while the job runs.
+ *
+ * Returns the job's exit status (see supervisor_exit_status()), or
+ * SUPERVISOR_TIMEOUT_STATUS if it timed out.
+ */
+int supervisor_wait(pid_t pid, int (*hook)(void *data), void *data) {
+	job_t *job = supervisor_find(pid);
+	int status;
+	
+	if (job == NULL) {
+		/* Not started through the supervisor, so wait for it directly. */
+		if (waitpid(pid, &status, 0) == -1) {
+			return 0;
+		}
+		
+		return supervisor_exit_status(status);
+	}
+	
+	while (!job->done) {
+		if (hook != NULL && hook(data) == FALSE) {
+			hook = NULL;
+		}
+		
+		supervisor_dispatch((hook != NULL) ? 0 : -1);
+	}
+	
+	status = job->status;
+	supervisor_remove(job);
+	
+	return status;
+}
+
+/**
+ * int supervisor_wait_input(int fd)
+ *
+ * Runs the event loop until the given descriptor becomes readable, so
+ * that background jobs are reaped and timed out while the shell waits
+ * for input.
+ *
+ * Returns 0 if successful, -1 if the descriptor cannot be watched.
+ */
+int supervisor_wait_input(int fd) {
+	struct epoll_event event;
+	
+	event.events = EPOLLIN;
+	event.data.ptr = &input_marker;
+	
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+		return -1;
+	}
+	
+	while (supervisor_dispatch(-1) == FALSE) {
+	}
+	
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	
+	return 0;
+}
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ *
+ * Copyright 2011 Evan Christopher Davis <ecdavis@wtfrak.com>
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***** Defines **************************************************************/
+
+#define SUPERVISOR_MAX_EVENTS 64
+#define SUPERVISOR_TIMEOUT_STATUS 124
+
+
+/***** Structures ***********************************************************/
+
+/* Job Structure - A child process being supervised. */
+typedef struct job_s {
+	pid_t pid;
+	int background;
+	int done;
+	int status;
+	int timed_out;
+	int timer_fd;
+	struct job_s *next;
+	} job_t;
+
+
+/***** Function Declarations ************************************************/
+
+/* Supervisor Functions */
+int supervisor_init();
+int supervisor_active();
+void supervisor_child();
+void supervisor_exec_begin();
+void supervisor_exec_failed();
+int supervisor_exit_status(int wait_status);
+
+/* Job Functions */
+void supervisor_add(pid_t pid, int background);
+int supervisor_set_timeout(pid_t pid, double seconds);
+int supervisor_wait(pid_t pid, int (*hook)(void *data), void *data);
+int supervisor_wait_input(int fd);
@@ -18,15 +18,25 @@
 
 /***** Includes *************************************************************/
 
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 #include "expression.h"
+#include "input.h"
 #include "interpreter.h"
 #include "parser.h"
+#include "readahead.h"
+#include "history.h"
+#include "lineedit.h"
+#include "cache.h"
+#include "server.h"
+#include "supervisor.h"
 #include "tmnsh.h"
 
 
@@ -42,108 +52,130 @@ void show_welcome() {
 }
 
 /**
- * void show_prompt()
+ * void format_prompt(char *prompt, int prompt_size)
  *
- * Prints the prompt (currently the current working directory) to the
- * standard output.
+ * Writes the prompt (currently the current working directory) into the
+ * buffer supplied.
  */
-void show_prompt() {
+void format_prompt(char *prompt, int prompt_size) {
 	char cwd[CWD_MAX_SIZE];
 	
-	getcwd(cwd, CWD_MAX_SIZE);
+	if (getcwd(cwd, CWD_MAX_SIZE) == NULL) {
+		cwd[0] = '\0';
+	}
 	
-	printf("%s > ", cwd);
+	snprintf(prompt, prompt_size, "%s > ", cwd);
 }
 
 /**
- * void show_usage()
+ * void show_prompt()
  *
- * Prints a usage message to the standard output.
+ * Prints the prompt to the standard output.
  */
-void show_usage() {
-	printf("usage: tmnsh [filename]\n");
+void show_prompt() {
+	char prompt[CWD_MAX_SIZE + 4];
+	
+	format_prompt(prompt, CWD_MAX_SIZE + 4);
+	
+	printf("%s", prompt);
 }
 
-
-/***** Input Functions ******************************************************/
-
 /**
- * int read_data(FILE *stream, char *buffer, int buffer_size)
- *
- * Reads at most buffer_size-1 bytes of input from the given stream into
- * the buffer supplied.
- *
- * NOTE Semicolons are treated as newline characters.
- * NOTE If a line of input is too long to fit in the buffer, it will
- *      NOT result in an overflow, but simply be "chomped" from the
- *      input stream and discarded.
- * NOTE Hash characters ('#') and any following characters up to a
- *      newline or EOF will be discarded - comment your scripts!
+ * void show_usage()
  *
- * Returns TRUE if there is more data to read from the stream, FALSE
- * otherwise.
+ * Prints a usage message to the standard output.
  */
-int read_data(FILE *stream, char *buffer, int buffer_size) {
-	char character;
-	char *buf = buffer;
-	int bytes_read = 0;
-	
-	while (bytes_read <= buffer_size-1) {
-		character = fgetc(stream);
-		
-		if (character == ';' || character == '\n' || character == EOF ||
-			character == '#') {
-				break;
-		}
-		
-		*buf++ = character;
-		bytes_read++;
-	}
-	
-	*buf = '\0';
-	
-	while ((character != ';') && (character != '\n') && (character != EOF)) {
-		character = fgetc(stream);
-	}
-	
-	if (character == EOF) {
-		return FALSE;
-	} else {
-		return TRUE;
-	}
+void show_usage() {
+	printf("usage: tmnsh [filename]\n"
+		   "       tmnsh -c command [name [args...]]\n"
+		   "       tmnsh --server socket\n");
 }
 
 
 /***** Main Interpreter Loop ************************************************/
 
 /**
- * void main_loop(FILE *stream, int interactive)
+ * int main_loop(input_t *input, int interactive)
  *
- * Reads, tokenises, parses ane executes input from the given stream. If
+ * Reads, tokenises, parses ane executes input from the given source. If
  * interactive mode is on, outputs a welcome message and a prompt.
+ * Otherwise the input is handed to script_loop().
+ *
+ * NOTE If interactive input comes from a terminal, lines are read with
+ *      the line editor and kept in the history file instead; each line
+ *      edited is then read back expression by expression.
+ *
+ * Returns the exit status of the last expression interpreted, or 2 if
+ * the last line could not be tokenised or parsed.
  */
-void main_loop(FILE *stream, int interactive) {
+int main_loop(input_t *input, int interactive) {
 	char buffer[BUFFER_MAX_SIZE];
 	char last_line[BUFFER_MAX_SIZE];
+	char line[BUFFER_MAX_SIZE];
+	char prompt[CWD_MAX_SIZE + 4];
+	input_t line_input;
+	history_t *history = NULL;
+	int editing = FALSE;
 	int more_to_read = TRUE;
+	int status = 0;
 	tokarray_t *tokens;
 	expression_t *expr;
 	
+	if (interactive == FALSE) {
+		return script_loop(input, NULL);
+	}
+	
 	bzero(buffer, BUFFER_MAX_SIZE);
 	bzero(last_line, BUFFER_MAX_SIZE);
 	
 	if (interactive == TRUE) {
 		show_welcome();
+		
+		if (isatty(fileno(input->stream)) && isatty(STDOUT_FILENO)) {
+			editing = TRUE;
+			history = history_open();
+			line[0] = '\0';
+			input_init_string(&line_input, line);
+		} else if (input_pending(input) == -1) {
+			/* Nothing may sit unseen in the stream's buffer while the
+			 * supervisor waits for the descriptor to become readable. */
+			setvbuf(input->stream, NULL, _IONBF, 0);
+		}
 	}
 	
 	while (more_to_read == TRUE) {
-		if (interactive == TRUE) {
-			show_prompt();
+		if (editing == TRUE) {
+			/* Edit a new line once the last one has been used up. */
+			if (*line_input.cursor == '\0') {
+				format_prompt(prompt, CWD_MAX_SIZE + 4);
+				fflush(stdout);
+				
+				more_to_read = lineedit_read(history, prompt, line,
+						BUFFER_MAX_SIZE);
+				
+				if (history != NULL) {
+					history_add(history, line);
+				}
+				
+				input_init_string(&line_input, line);
+			}
+			
+			input_read_line(&line_input, buffer, BUFFER_MAX_SIZE);
+		} else {
+			if (interactive == TRUE) {
+				show_prompt();
+				fflush(stdout);
+				
+				/* Reap and time out jobs until more input arrives. */
+				if (supervisor_active() && input_pending(input) != TRUE) {
+					supervisor_wait_input(fileno(input->stream));
+				}
+			}
+			
+			/* Read a line of input. */
+			more_to_read = input_read_line(input, buffer, BUFFER_MAX_SIZE);
 		}
 		
-		/* Read a line of input. */
-		more_to_read = read_data(stream, buffer, BUFFER_MAX_SIZE);
-		
 		if (strlen(buffer) == 0) {
 			continue;
 		}
@@ -155,34 +187,96 @@ void main_loop(FILE *stream, int interactive) {
 		
 		if (tokens == NULL) {
 			printf("!tmnsh: Could not tokenise input: %s\n", last_line);
+			status = INTERPRET_SYNTAX_STATUS;
 			continue;
 		}
 		
 		/* Parse the tokens into an expression. */
 		expr = parse_tokens(tokens);
+		tokarray_destroy(tokens); /* Clean up. */
 		
 		if (expr == NULL) {
 			printf("!tmnsh: Could not parse input: %s\n", last_line);
-			tokarray_destroy(tokens); /* Clean up. */
+			status = INTERPRET_SYNTAX_STATUS;
 			continue;
 		}
 		
 		/* Interpret the expression and execute the commands. */
-		interpret_expression(expr);
+		status = interpret_expression(expr);
 		
 		expression_destroy(expr); /* Clean up. */
 		bzero(buffer, BUFFER_MAX_SIZE);
 		bzero(last_line, BUFFER_MAX_SIZE);
 	}
+	
+	history_close(history);
+	
+	return status;
+}
+
+/**
+ * int script_loop(input_t *input, const char *path)
+ *
+ * Executes non-interactive input from the given source. Lines are read,
+ * tokenised and parsed into a bounded read-ahead queue while foreground
+ * commands run, hiding the shell's own overhead behind their runtime.
+ * When nothing follows the final expression, its last command is run
+ * in place of the shell (see interpret_expression()).
+ *
+ * NOTE If the input is a script file, its path should be given so that
+ *      the parsed script can be cached (see cache_open()). Otherwise
+ *      path should be NULL.
+ *
+ * Returns the exit status of the last expression interpreted, or 2 if
+ * the last line could not be tokenised or parsed.
+ */
+int script_loop(input_t *input, const char *path) {
+	readahead_t *ra = readahead_create(input);
+	readahead_entry_t entry;
+	cache_writer_t *writer = NULL;
+	cache_t *cache = NULL;
+	int status = 0;
+	
+	if (path != NULL) {
+		cache = cache_open(path, &writer);
+		readahead_set_cache(ra, cache, writer);
+	}
+	
+	interpret_set_idle_hook(readahead_idle, ra);
+	
+	while (readahead_pop(ra, &entry) == TRUE) {
+		if (entry.error == READAHEAD_TOKENISE_ERROR) {
+			printf("!tmnsh: Could not tokenise input: %s\n", entry.line);
+			status = INTERPRET_SYNTAX_STATUS;
+			free(entry.line);
+			continue;
+		} else if (entry.error == READAHEAD_PARSE_ERROR) {
+			if (entry.message != NULL) {
+				printf("%s", entry.message);
+			}
+			
+			printf("!tmnsh: Could not parse input: %s\n", entry.line);
+			status = INTERPRET_SYNTAX_STATUS;
+			free(entry.line);
+			free(entry.message);
+			continue;
+		}
+		
+		entry.expr->tail = readahead_at_end(ra);
+		status = interpret_expression(entry.expr);
+		
+		expression_destroy(entry.expr); /* Clean up. */
+	}
+	
+	interpret_set_idle_hook(NULL, NULL);
+	readahead_destroy(ra);
+	
+	return status;
 }
 
 
 /***** Signal Handlers ******************************************************/
 
-void sigchld_handler(int sig) {
-	wait(NULL);
-}
-
 void sigint_handler(int sig) {
 	fflush(stdout);
 }
@@ -190,33 +284,79 @@ void sigint_handler(int sig) {
 
 /***** Main Function ********************************************************/
 
+/**
+ * int run_command_string(const char *string)
+ *
+ * The one-shot "-c" startup path, used when tmnsh stands in for /bin/sh
+ * (i.e. system() and make). Expressions are read straight out of the
+ * argument string and no welcome message, prompt or signal handlers are
+ * set up, so that a cold start costs as little as possible. Children are
+ * waited for with waitpid() rather than through the supervisor.
+ *
+ * Returns the exit status of the last expression interpreted.
+ */
+int run_command_string(const char *string) {
+	input_t input;
+	
+	input_init_string(&input, string);
+	
+	return main_loop(&input, FALSE);
+}
+
 /**
  * int main(int argc, char *argv[], char *envp)
  *
- * Determines whether to run in interactive mode or to read in
- * expressions from a file.
+ * Determines whether to run a command string, serve clients over a
+ * socket, run in interactive mode or to read in expressions from a file.
+ *
+ * NOTE Any arguments following a "-c" command string are accepted for
+ *      compatibility with /bin/sh but are otherwise ignored, since
+ *      tmnsh has no positional parameters.
  */
 int main(int argc, char *argv[], char *envp[]) {
-	signal(SIGCHLD, sigchld_handler);
+	input_t input;
+	int status = 0;
+	
+	if (argc >= 2 && strcmp(argv[1], "-c") == 0) {
+		if (argc < 3) {
+			show_usage();
+			return 2;
+		}
+		
+		return run_command_string(argv[2]);
+	}
+	
+	if (argc >= 2 && strcmp(argv[1], "--server") == 0) {
+		if (argc != 3) {
+			show_usage();
+			return 2;
+		}
+		
+		return server_run(argv[2]);
+	}
+	
+	supervisor_init();
 	signal(SIGINT, sigint_handler);
 	
 	if (argc > 2) {
 		show_usage();
 	} else if (argc == 2) {
-		/* Read expressions from a file. */
-		FILE *file = fopen(argv[1], "r");
+		/* Read expressions from a file, which no child should inherit. */
+		FILE *file = fopen(argv[1], "re");
 		
 		if (file == NULL) {
 			printf("!tmnsh: Could not open file '%s'.\n", argv[1]);
 			exit(1);
 		}
 		
-		main_loop(file, FALSE);
+		input_init_stream(&input, file);
+		status = script_loop(&input, argv[1]);
 		fclose(file);
 	} else {
 		/* Read expressions from standard input. */
-		main_loop(stdin, TRUE);
+		input_init_stream(&input, stdin);
+		status = main_loop(&input, TRUE);
 	}
 	
-	return 0;
+	return status;
 }
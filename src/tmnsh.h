@@ -28,18 +28,20 @@
 
 /* CLI Functions */
 void show_welcome();
+void format_prompt(char *prompt, int prompt_size);
 void show_prompt();
 void show_usage();
 
-/* NOTE The below two declarations are commented out because expression.h
- *      has a hissy fit about the FILE type when compiling and including
- *      the relevant header in this header doesn't seem to address that.
+/* Main Interpreter Loop
+ *
+ * NOTE The input source is declared incompletely here so that this
+ *      header does not drag stdio.h into every file that includes it;
+ *      see input.h for the full structure.
  */
-/* Input Functions */
-/*int read_data(FILE *stream, char *buffer, int buffer_size);*/
-
-/* Main Interpreter Loop */
-/*void main_loop(FILE *stream, int interactive);*/
+struct input_s;
+int main_loop(struct input_s *input, int interactive);
+int script_loop(struct input_s *input, const char *path);
+int run_command_string(const char *string);
 
 /* Main Function */
 int main(int argc, char *argv[], char *envp[]);